@@ -0,0 +1,283 @@
+
+// SimAnalogIn Development Version
+
+/*
+     * Copyright 2012 Jack Deeth
+     * Contact: simulationelectronics@gmail.com
+     *
+     * Potentiometers for throttles, trim wheels and brightness knobs,
+     * oversampled, filtered and mapped onto a dataref, which is only
+     * written when the knob has really moved.
+     *
+     * This program is free software: you can redistribute it and/or modify
+     * it under the terms of the GNU Lesser General Public License as
+     * published by the Free Software Foundation, either version 3 of the
+     * License, or (at your option) any later version.
+     *
+     * This program is distributed in the hope that it will be useful,
+     * but WITHOUT ANY WARRANTY; without even the implied warranty of
+     * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+     * GNU Lesser General Public License for more details.
+     *
+     * You should have received a copy of the GNU Lesser General Public
+     * License along with this program.
+     * If not, see <http://www.gnu.org/licenses/>.
+     *
+     * I would appreciate, but not insist, on attribution if this code is
+     * incorporated into other projects.
+     */
+
+#ifndef SIMANALOGINDEV_H
+#define SIMANALOGINDEV_H
+
+#include "SimObjectsDev.h"
+#include "SimScaleMapDev.h"
+#include "SimDataRefDev.h"
+
+
+//! An analog input, such as a potentiometer, driving a float dataref.
+/*! Each update averages several analogRead()s, smooths them with a
+ *  fixed-point moving average, and ignores changes smaller than the
+ *  hysteresis, so a pot sitting still reads still. The position is
+ *  then mapped onto the dataref, and the dataref written only if it
+ *  moved by at least the threshold. X-Plane sees a few writes while the
+ *  knob turns and none at all while it rests, rather than ADC noise
+ *  every loop.
+ *
+ *  The map is a ScaleMap run the other way from a SimServo's: inputs
+ *  are ADC counts, 0 to 1023, and outputs are dataref values. Inputs
+ *  are read in the sample phase, every 10ms by default (see
+ *  setInterval()).
+ *  \code
+ *  DataRefIdent throttleIdent[] = "sim/flightmodel/engine/ENGN_thro[0]";
+ *  DataRefIdent brightIdent[] = "sim/cockpit/electrical/instrument_brightness";
+ *
+ *  // throttle: idle detent at the bottom tenth of travel
+ *  ScaleMap throttleMap = { {0, 0}, {100, 0}, {1023, 1} };
+ *  SimAnalogIn throttle(A0, throttleIdent, throttleMap);
+ *  // panel brightness, fitted upside down
+ *  SimAnalogIn panelLights(A1, brightIdent, 0, 1);
+ *  ...
+ *  panelLights.reverse(true);
+ *  \endcode
+ */
+class SimAnalogIn : public SimObject {
+public:
+  //! Map the pin's whole travel linearly from minimum to maximum.
+  //! ident is a DataRefIdent, or from SIM_DATAREF_TABLE, in program
+  //! memory.
+  //! \param threshold Smallest change of the dataref worth sending.
+  //!        0 (the default) is one ADC count's worth of output.
+  SimAnalogIn(int pin, const char *ident, float minimum, float maximum,
+              float threshold = 0) :
+    SimObject(0),
+    _pin(pin)
+  {
+    _linear[0][0] = 0;
+    _linear[0][1] = minimum;
+    _linear[1][0] = 1023;
+    _linear[1][1] = maximum;
+    _init(ident, _linear, 2, threshold);
+  }
+
+  //! Map the pin's ADC counts through map. The number of pairs is taken
+  //! from the ScaleMap's declaration, and may be at most
+  //! SIM_SCALEMAP_PAIRS.
+  template <size_t N>
+  SimAnalogIn(int pin, const char *ident, const double (&map)[N][2],
+              float threshold = 0) :
+    SimObject(0),
+    _pin(pin)
+  {
+    SIM_STATIC_ASSERT(N >= 2, ScaleMap_needs_at_least_two_pairs);
+    SIM_STATIC_ASSERT(N <= SIM_SCALEMAP_PAIRS, ScaleMap_longer_than_SIM_SCALEMAP_PAIRS);
+    _init(ident, map, N, threshold);
+  }
+
+  //! Average samples analogRead()s per update: 1, 2, 4, 8 or 16 (the
+  //! most). Others are rounded down. Default 4.
+  void setOversample(unsigned char samples) {
+    _oversampleShift = 0;
+    while (_oversampleShift < 4 && (2 << _oversampleShift) <= samples)
+      ++_oversampleShift;
+  }
+
+  //! Weight each update by 1/2^shift in the moving average: 0 for none,
+  //! up to 6 for a slow, heavily smoothed input. Default 2.
+  void setSmoothing(unsigned char shift) {
+    shift = shift > 6 ? 6 : shift;
+    // keep the average at the same position under the new weight
+    _average = (_average >> _smoothing) << shift;
+    _smoothing = shift;
+  }
+
+  //! Ignore movements of less than counts ADC counts. Default 2.
+  void setHysteresis(unsigned char counts) { _hysteresis = counts << 4; }
+
+  //! Smallest change of the dataref worth sending
+  void setThreshold(float threshold) { _threshold = threshold; }
+
+  //! Read the pin's travel the other way round, so the map's first
+  //! input is the pin at full scale
+  void reverse(bool reversed) { _reversed = reversed; }
+
+  //! Filtered ADC counts, after hysteresis
+  float position(void) const { return _held / 16.0f; }
+
+  //! Mapped value of position()
+  float value(void) const { return _value; }
+
+  //! Value last written to the dataref
+  float sent(void) const { return _sent; }
+
+private:
+  int _pin;
+
+  //! Output dataref, shared with other objects using it
+  FlightSimFloat *_dr;
+
+  //! ADC counts to dataref values
+  SimScaleMap _map;
+  bool _mapValid;
+
+  //! Map for the minimum/maximum constructor
+  double _linear[2][2];
+
+  unsigned char _oversampleShift;
+  unsigned char _smoothing;
+  bool _reversed;
+  bool _primed;
+
+  //! Hysteresis, in ADC counts with four binary places
+  unsigned int _hysteresis;
+
+  //! Moving average of samples, with four binary places plus _smoothing
+  unsigned long _average;
+
+  //! Position, with four binary places, moved only past the hysteresis
+  unsigned int _held;
+
+  float _value;
+  float _sent;
+  float _threshold;
+
+  //! Outputs at the two ends of the map, always sent when reached
+  float _first;
+  float _last;
+
+  //! X-Plane link state at the last _update()
+  bool _lastEnabled;
+
+  //! Full scale, with four binary places
+  enum { Full = 1023 << 4 };
+
+  //! Shared constructor body
+  void _init(const char *ident, const double (*map)[2], unsigned int pairs,
+             float threshold) {
+    _dr = &SimDataRefs::floatRef(ident);
+    _oversampleShift = 2;
+    _smoothing = 2;
+    _reversed = false;
+    _primed = false;
+    _hysteresis = 2 << 4;
+    _average = 0;
+    _held = 0;
+    _value = 0;
+    _sent = 0;
+    _lastEnabled = false;
+
+    _mapValid = _map.init(map, pairs);
+    if (!_mapValid)
+      return;
+    _first = (float)map[0][1];
+    _last = (float)map[pairs - 1][1];
+
+    // one ADC count's worth of the map's output range
+    if (threshold <= 0) {
+      double lo = map[0][1];
+      double hi = lo;
+      for (unsigned int i = 1; i < pairs; ++i) {
+        if (map[i][1] < lo)
+          lo = map[i][1];
+        if (map[i][1] > hi)
+          hi = map[i][1];
+      }
+      threshold = (float)((hi - lo) / 1023);
+    }
+    _threshold = threshold;
+
+    setInterval(10);
+    _addToGroup(_typeGroup);
+  }
+
+  //! A dataref which is written needs identifying to X-Plane
+  void _setup(void) { SimDataRefs::subscribe(*_dr); }
+
+  void _update(bool updateOutput = true);
+
+  friend class SimObject;
+  static SimGroup _typeGroup;
+  void _updateDirect(bool updateOutput) { SimAnalogIn::_update(updateOutput); }
+};
+
+
+// sampled with the switches, before anything uses the datarefs
+SimGroup SimAnalogIn::_typeGroup = SIM_GROUP(SimAnalogIn, SimObject::LevelSwitch);
+
+
+
+void SimAnalogIn::_update(bool /*updateOutput*/) {
+  // oversample, to four binary places
+  unsigned int sum = 0;
+  for (unsigned char n = 1 << _oversampleShift; n > 0; --n)
+    sum += SimHAL::readAnalog(_pin);
+  unsigned int sample = sum << (4 - _oversampleShift);
+  if (_reversed)
+    sample = Full - sample;
+
+  // moving average: _average holds 2^_smoothing samples' worth
+  if (!_primed) {
+    _average = (unsigned long)sample << _smoothing;
+    _held = sample;
+  } else
+    _average = _average - (_average >> _smoothing) + sample;
+  unsigned int filtered = _average >> _smoothing;
+
+  // follow the input at the hysteresis' distance, but reach the ends
+  bool moved = !_primed;
+  if (filtered > _held + _hysteresis) {
+    _held = (filtered + _hysteresis >= Full) ? (unsigned int)Full : filtered - _hysteresis;
+    moved = true;
+  } else if (filtered + _hysteresis < _held) {
+    _held = (filtered <= _hysteresis) ? 0 : filtered + _hysteresis;
+    moved = true;
+  }
+  _primed = true;
+
+  if (moved) {
+    long out = _map.lookup(_held / 16.0f);
+    _value = (float)out / (float)(1L << _map.outShift());
+    // exact ends, not the fixed-point approximation of them
+    if (_held == 0)
+      _value = _first;
+    else if (_held == Full)
+      _value = _last;
+  }
+
+  // send on change, and when X-Plane connects
+  bool enabled = SimHAL::simEnabled();
+  bool sync = enabled && !_lastEnabled;
+  _lastEnabled = enabled;
+  if (!enabled)
+    return;
+  float change = _value - _sent;
+  if (sync
+      || change >= _threshold || -change >= _threshold
+      || (_value != _sent && (_value == _first || _value == _last))) {
+    _dr->write(_value);
+    _sent = _value;
+  }
+}
+
+
+#endif // SIMANALOGINDEV_H
@@ -2,7 +2,9 @@
 //
 // SimAnnc Development Version
 //
-// This is a derivative of SimLED, incorporating a Master Warning system.
+// Annunciator logic built from SimLEDs: nodes which light from their
+// inputs, and which can be combined to any depth into master caution
+// and warning systems.
 // Copyright 2012 Jack Deeth
 //
 // This program is free software: you can redistribute it and/or
@@ -28,337 +30,160 @@
 #define SIMANNCDEV_H
 
 #include "SimLEDDev.h"
-enum SimAnncType {
-    SAUndefined,
-    SAMaster,
-    SAInt,
-    SAFloat
-};
-
-//class SimLED {
-//public:
-//    // Constructors
-//    // if enableTest is True, the LED will be lit by the lightTest function.
-//    // if enableFlash is True, the flash filter will apply to this SimLED.
-
-//    // Create Master SimLED
-//    // It will be lit by annunciator LEDs created AFTER it, until another
-//    // Master SimLED is defined or the last SimLED is declared.
-//    //
-//    // The compiler will regard SimLED(pinNo, false) as SimLED(int, int)
-//    // and complain of ambiguity between Master and Int Annc constructors.
-//    // In this case, cast to boolean:
-//    // SimLED(pinNo, (bool) false);
-//    //
-//    // Annunciators created before the first Master SimLED
-//    SimLED(const int    &masterLedPin,
-//           const bool   &enableTest = true,
-//           const bool   &enableFlash = true);
-
-//    // Create Annunciator SimLEDs
-//    // lowLimit and highLimit define the range where the SimLED is ACTIVE.
-//    //
-//    // example: SimLED takeoffTrim(10, &elevTrimDR, 0.10, 0.15);
-//    // active when trim is between 0.10 and 0.15
-//    //
-//    // If invertLimits is True, this is reversed, and they define the range where
-//    // the annunciator is INACTIVE.
-//    //
-//    // example: SimLED balanceWarn(10, &cOfGPosition, 0.20, -0.10);
-//    // balanceWarn will be inactive when the dataref is less than 0.20 and
-//    // greater than -0.10 inclusive. Therefore it will be Active outside of that
-//    // range.
-//    //
-//    // Integer annunciator limit values are inclusive.
-//    //
-//    SimLED(const int    &ledPin,
-//           FlightSimInteger *dr,
-//           const int    &lowLimit     = 1,
-//           const int    &highLimit    = 32000,
-//           const bool   &invertLimits = false,
-//           const bool   &enableTest   = true,
-//           const bool   &enableFlash  = false);
-
-//    SimLED(const int    &ledPin,
-//           FlightSimFloat *dr,
-//           const float  &lowLimit,
-//           const float  &highLimit,
-//           const bool   &invertLimits = false,
-//           const bool   &enableTest   = true,
-//           const bool   &enableFlash  = false);
-
-//    // Set up all SimLED objects. This simply calls setup_ on each instance of
-//    // SimLED, setting the pinMode to OUTPUT.
-//    //
-//    // Call this in the Arduino setup() function.
-//    static void setup(void);
-
-//    // Update all SimLED objects. This takes input from the datarefs, applies
-//    // annunciator system logic to determine which are Active, and then applies
-//    // other filters to determine which are Lit. If updateOutput is True, then
-//    // each LED pin is set High or Low as well.
-//    //
-//    // Call this in the Arduino loop() function.
-//    static void update (bool updateOutput = true);
-
-//    // A SimLED isActive when the state of the datarefs and annunciators would
-//    // cause it to light. isLit is isActive with filters applied, to override
-//    // the LED state for the following functions:
-//    // - Light test
-//    // - Light flasher
-//    // - Simulator state (LEDs extinguish when sim is inactive)
-//    //
-//    // For example, a flashing master warning SimLED is continually Active,
-//    // but alternately Lit and not Lit. A SimLED illuminated by a test is
-//    // Lit but not Active.
-//    //
-//    bool isActive(void) { return active_; }
-//    bool isLit(void)    { return lit_ ; }
-
-//    // Acknowledges currently lit Annunciator SimLEDs belonging to this Master
-//    // SimLED and extinguishes the Master SimLED.
-//    //
-//    // masterReset has no effect when called on SimLEDs that aren't Master SimLEDs.
-//    //
-//    void masterReset(void);
-
-//    // while hasPower is false, all SimLEDs are extinguished. Represents simulated
-//    // power from X-Plane, not physical electrical power on the USB supply!
-//    static void isPowered(bool hasPower = true){ hasPower_ = hasPower; }
-
-//    // Operate the flashing sequence for flash-enabled SimLEDs.
-//    // When called with True, all flash-enabled SimLEDs will light when Active.
-//    // When called with False, they will be extinguished.
-//    static void flash (bool litNow)       { flashNow_ = litNow; }
-
-//    // Sets whether this SimLED will react to the flash filter
-//    void enableFlash (bool allowFlash)    { allowFlash_ = allowFlash; }
-
-//    // While called with 'true', will override enabled SimLEDs to light up.
-//    static void lightTest(bool lightAll)  {testAll_ = lightAll;}
-
-//    // Enables or disables this SimLED's participation in lightTests
-//    void enableTest (bool allowTest)      {allowTest_ = allowTest;}
-
-//private:
-//    // Hardware pin of output LED
-//    int pin_;
-
-//    // Defines this as Master, Int Annc., or Float Annc.
-//    SimLedType type_;
-
-//    // Annc is active when dataref is between Low and High limits, unless
-//    // it is Inverse. Inverse anncs are active when dataref is NOT between
-//    // Low and High limits. Range is inclusive.
-//    bool inverse_;
-
-//    FlightSimInteger * drInt_;
-//    int lowLimitI_;
-//    int highLimitI_;
-
-//    FlightSimFloat * drFloat_;
-//    float lowLimitF_;
-//    float highLimitF_;
-
-//    // Annc input data is in range to activate this annc.
-//    bool active_;
-
-//    // Per annc system simulation, this annc LED should be lit.
-//    bool lit_;
-
-//    // This Active_ annc has been Ack_nowledged by Master Reset key
-//    bool ack_;
-
-//    void addToLinkedList(void);
-//    void setup_ (void) {pinMode(pin_, OUTPUT);}
-//    void update_(bool updateOutput = true);
 
-//    bool allowTest_;
-//    bool allowFlash_;
-
-//    static bool hasPower_;
-//    static bool testAll_;
-//    static bool flashNow_;
-
-//    // Number of SimLEDs created
-//    static int count_;
-//    // Pointer to first SimLED in linked list
-//    static SimLED* first_;
-//    // Pointer to next SimLED in linked list. == 0 if this is last element
-//    SimLED* next_;
-//};
-
-////////////
-//// Constructors
-////
-//SimLED::SimLED(const int  &masterLedPin,
-//               const bool &enableTest,
-//               const bool &enableFlash) {
-//    pin_        = masterLedPin;
-//    type_       = SLMaster;
-//    allowTest_  = enableTest;
-//    allowFlash_ = enableFlash;
-//    addToLinkedList();
-//}
-
-//SimLED::SimLED(const int  &ledPin,
-//               FlightSimInteger *dr,
-//               const int  &lowLimit,
-//               const int  &highLimit,
-//               const bool &invertLimits,
-//               const bool &enableTest,
-//               const bool &enableFlash) {
-//    pin_          = ledPin;
-//    type_         = SLInt;
-//    drInt_        = dr;
-//    lowLimitI_    = lowLimit;
-//    highLimitI_   = highLimit;
-//    inverse_      = invertLimits;
-//    allowTest_    = enableTest;
-//    allowFlash_   = enableFlash;
-//    addToLinkedList();
-//}
-
-//SimLED::SimLED(const int    &ledPin,
-//               FlightSimFloat *dr,
-//               const float  &lowLimit,
-//               const float  &highLimit,
-//               const bool   &invertLimits,
-//               const bool   &enableTest,
-//               const bool   &enableFlash) {
-//    pin_          = ledPin;
-//    type_         = SLFloat;
-//    drFloat_      = dr;
-//    lowLimitF_    = lowLimit;
-//    highLimitF_   = highLimit;
-//    inverse_      = invertLimits;
-//    allowTest_    = enableTest;
-//    allowFlash_   = enableFlash;
-//    addToLinkedList();
-//}
-
-//void SimLED::addToLinkedList() {
-//    next_ = 0;
-
-//    if (count_++ == 0) {
-//        first_ = this;
-//    } else {
-//        // Go through linked list and make last existing element point to us
-//        SimLED *a = first_;
-//        while (a->next_)
-//            a = a->next_;
-//        a->next_ = this;
-//    }
-//}
-
-//// Run setup_() function on each instance of SimLED
-//void SimLED::setup() {
-//    if (count_ > 0) {
-//        SimLED* buf = first_;
-//        while (buf != 0) {
-//            buf->setup_();
-//            buf = buf->next_;
-//        }
-//    }
-//}
-
-//// Run update()_ on each instance of SimLED
-//// if updateOutput, set LED pins according to lit_ status
-//void SimLED::update( bool updateOutput) {
-//    if (count_ > 0) {
-//        SimLED* buf = first_;
-//        while (buf != 0) {
-//            buf->update_(updateOutput);
-//            buf = buf->next_;
-//        }
-//    }
-//}
-
-//// Determine whether this SimLED should be lit
-//void SimLED::update_(bool updateOutput) {
-//    switch (type_) {
-//    case SLMaster: {
-//        // If we set active_ to false here, Master SimLEDs will extinguish
-//        // when all their annunciators are out. Without this line, they stay
-//        // lit until the Reset button is pressed.
-
-//        // active_ = false;
-
-//        SimLED *buf = next_;
-//        while ( (buf->type_ != SLMaster) && (buf != 0) ) {
-//            // Step through anncs until we reach the end, or the next Master
-//            // Activate this Master if any unAck'd Active anncs are found
-//            active_ += (buf->active_ && !buf->ack_);
-//            // reset acknowledgements for inactive anncs
-//            if (!buf->active_)
-//                buf->ack_ = false;
-//            buf = buf->next_;
-//        }
-//    }
-//        break;
-//        // for regular anncs, we are active if our dataref is within the limits.
-//    case SLInt:
-//        active_ = (lowLimitI_ <= *drInt_ && *drInt_ <= highLimitI_);
-//        if(inverse_ == true)
-//            active_ = !active_;
-//        break;
-//    case SLFloat:
-//        active_ = (lowLimitF_ <= *drFloat_&& *drFloat_ <= highLimitF_);
-//        if(inverse_ == true)
-//            active_ = !active_;
-//        break;
-//    default:
-//        return;
-//    }
-
-//    lit_ = active_;
-
-//    // apply lit_ filters:
-
-//    // we are lit if bulb-test is active
-//    if( (allowTest_ == true) && (testAll_ == true) )
-//        lit_ = true;
-
-//    // we are not lit if we're a flashing light and the flash timers says not to
-//    if ( (allowFlash_ == true) && (flashNow_ == false) )
-//        lit_ = false;
-
-//    // we are not lit if the sim isn't running or we have no simulated power
-//    if( (FlightSim.isEnabled() == false) || (hasPower_ == false) ) {
-//        lit_ = false;
-//    }
-
-//    // unless ordered otherwise, light or extinguish LED based on our lighting state
-//    if (updateOutput)
-//        digitalWrite(pin_, lit_);
-//}
-
-//void SimLED::masterReset() {
-//    // do nothing if this isn't a Master
-//    if(type_ != SLMaster)
-//        return;
-
-//    // Acknowledge all our Active anncs, which are the subsequent anncs in
-//    // the list, until we reach another Master or the end.
-//    SimLED *buf = next_;
-//    while((buf->type_ != SLMaster) && (buf != 0)) {
-//        buf->ack_ = buf->isActive();
-//        buf = buf->next_;
-//    }
-//    // Resetting the Master extinguishes it.
-//    active_ = false;
-//}
+//! Most inputs to one SimAnncNode
+#ifndef SIM_MAX_ANNC_INPUTS
+#define SIM_MAX_ANNC_INPUTS 32
+#endif
 
-//// Initialise static data members
-//int SimLED::count_      = 0;
-//SimLED* SimLED::first_  = 0;
-//bool SimLED::hasPower_  = true;
-//bool SimLED::testAll_   = false;
-//bool SimLED::flashNow_  = true;
-//// flashNow defaults True. If user does not implement a flash timer, SimLEDs
-//// specified as flashing will instead stay steadily lit.
 
+//! Annunciator which lights from a list of input SimLEDs.
+/*! Inputs may be any SimLEDs, including other SimAnncNodes, so nodes
+ *  can be built into trees of any depth: a Boeing master caution over
+ *  system annunciators over their sub-annunciators, or an Airbus master
+ *  warning over ECAM groups.
+ *
+ *  Each input tells its node which input it is when it changes, so a
+ *  node keeps a count of active inputs rather than reading them all,
+ *  and a change only reaches the nodes above it. SimObject::setup()
+ *  puts every node after its inputs, so a change reaches the top in one
+ *  pass whatever order the nodes are declared in.
+ *  \code
+ *  SimLEDBase * const elecAnncs[] = { &gen1Off, &gen2Off, &busOff };
+ *  SimAnncNode elecSA(15, elecAnncs);
+ *  SimLEDBase * const sixPack[] = { &fltSA, &elecSA, &fuelSA };
+ *  SimAnncNode masterCaution(24, sixPack);
+ *  ...
+ *  if (resetButton.fallingEdge())
+ *    masterCaution.reset();        // and all the system annunciators
+ *  masterCaution.setRecall(recallButton.read() == LOW);
+ *  \endcode
+ */
+class SimAnncNode : public SimLEDBase {
+public:
+  //! Options for how a node follows its inputs. Combine with |.
+  enum Mode {
+    Any       = 0,  //!< Active condition: any input active
+    All       = 1,  //!< Active condition: every input active
+    Latching  = 2,  //!< Lights when an input becomes active while the
+                    //!< condition holds, and stays lit until reset().
+                    //!< Otherwise simply follows the condition.
+    Propagate = 4   //!< reset() and setRecall() are passed on to inputs
+  };
+
+  //! \param ledPin Arduino pin or SimOutput::pin() of this node's LED,
+  //!        or -1 if it only feeds other nodes
+  //! \param inputs SimLEDs feeding this node
+  //! \param mode Mode flags
+  //! \param enableTest Participate in SimLED bulb tests
+  //! \param hasPowerFlag Simulated power supply for this node
+  template <size_t N>
+  SimAnncNode(const int    &ledPin,
+              SimLEDBase   * const (&inputs)[N],
+              unsigned char mode = Any | Latching | Propagate,
+              const bool   &enableTest   = true,
+              const bool   *hasPowerFlag = &SimObject::hasPower)
+    : SimLEDBase(ledPin, enableTest, hasPowerFlag, _typeGroup)
+  {
+    SIM_STATIC_ASSERT(N >= 1 && N <= SIM_MAX_ANNC_INPUTS,
+                      SimAnncNode_inputs_out_of_range);
+    _inputs = inputs;
+    _inputCount = N;
+    _activeCount = 0;
+    _mode = mode;
+    _recall = false;
+    _rose = false;
+  }
+
+  //! Extinguish a latched node, until an input next becomes active
+  void reset(void) { _reset(); }
+
+  //! While recall is set, a latching node lights if its condition holds,
+  //! whether or not it was reset
+  void setRecall(bool mode) { _setRecall(mode); }
+
+  //! Number of active inputs
+  unsigned char activeInputs(void) const { return _activeCount; }
+
+private:
+  SimLEDBase * const *_inputs;
+  unsigned char _inputCount;
+  unsigned char _activeCount;
+  unsigned char _mode;
+  bool _recall;
+
+  //! An input has become active since the last evaluation
+  bool _rose;
+
+  //! Each input's state as last seen
+  SimBits<SIM_MAX_ANNC_INPUTS> _inputActive;
+
+  void _inputChangedAt(unsigned char slot, bool active) {
+    if (active == _inputActive.test(slot))
+      return;
+    if (active) {
+      _inputActive.set(slot);
+      ++_activeCount;
+      _rose = true;
+    } else {
+      _inputActive.reset(slot);
+      --_activeCount;
+    }
+  }
+
+  //! Called directly by _updateDirect(), so not for overriding
+  void _updateActive() SIM_FINAL {
+    // inputs which tell another listener have to be read
+    if (_pollInputs) {
+      for (unsigned char i = 0; i < _inputCount; ++i)
+        _inputChangedAt(i, _inputs[i]->isActive());
+    }
+
+    bool condition = (_mode & All) ? _activeCount == _inputCount
+                                   : _activeCount != 0;
+    if (!(_mode & Latching))
+      _active = condition;
+    else if (condition && (_rose || _recall))
+      _active = true;
+    _rose = false;
+  }
+
+  SimObject *_input(unsigned int i) {
+    return i < _inputCount ? _inputs[i] : 0;
+  }
+
+  void _reset(void) {
+    if (_mode & Propagate) {
+      for (unsigned char i = 0; i < _inputCount; ++i)
+        _inputs[i]->_reset();
+    }
+    if (_mode & Latching)
+      _active = false;
+    _inputChanged = true;
+  }
+
+  void _setRecall(bool mode) {
+    if (_mode & Propagate) {
+      for (unsigned char i = 0; i < _inputCount; ++i)
+        _inputs[i]->_setRecall(mode);
+    }
+    _recall = mode;
+    _inputChanged = true;
+  }
+
+  friend class SimObject;
+  static SimGroup _typeGroup;
+  void _updateDirect(bool updateOutput) {
+    if (_needsEvaluation()) {
+      _inputChanged = false;
+      SimAnncNode::_updateActive();
+    }
+    _updateLit(updateOutput);
+  }
+};
 
+// after the SimLEDs feeding them
+SimGroup SimAnncNode::_typeGroup = SIM_GROUP(SimAnncNode, SimObject::LevelLogic);
 
 
-#endif
+#endif // SIMANNCDEV_H
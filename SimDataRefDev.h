@@ -0,0 +1,318 @@
+
+// SimDataRef Development Version
+
+/*
+     * Copyright 2012 Jack Deeth
+     * Contact: simulationelectronics@gmail.com
+     *
+     * Shared dataref subscriptions, so SimObjects reading the same
+     * dataref use one FlightSimInteger or FlightSimFloat between them:
+     * one subscription, one copy in RAM and one update from X-Plane.
+     *
+     * This program is free software: you can redistribute it and/or modify
+     * it under the terms of the GNU Lesser General Public License as
+     * published by the Free Software Foundation, either version 3 of the
+     * License, or (at your option) any later version.
+     *
+     * This program is distributed in the hope that it will be useful,
+     * but WITHOUT ANY WARRANTY; without even the implied warranty of
+     * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+     * GNU Lesser General Public License for more details.
+     *
+     * You should have received a copy of the GNU Lesser General Public
+     * License along with this program.
+     * If not, see <http://www.gnu.org/licenses/>.
+     *
+     * I would appreciate, but not insist, on attribution if this code is
+     * incorporated into other projects.
+     */
+
+#ifndef SIMDATAREFDEV_H
+#define SIMDATAREFDEV_H
+
+#include "SimObjectsDev.h"
+
+//! Most distinct integer datarefs. Each costs one FlightSimInteger of
+//! RAM whether used or not, so define this before including the
+//! SimObjects headers to suit the panel.
+#ifndef SIM_DATAREF_INTS
+#define SIM_DATAREF_INTS 8
+#endif
+
+//! Most distinct float datarefs. As SIM_DATAREF_INTS.
+#ifndef SIM_DATAREF_FLOATS
+#define SIM_DATAREF_FLOATS 4
+#endif
+
+SIM_STATIC_ASSERT(SIM_DATAREF_INTS <= 255 && SIM_DATAREF_FLOATS <= 255,
+                  SIM_DATAREF_pools_too_large);
+
+//! Called with the identifier when a dataref is requested from a full
+//! pool, before it is given one of its own. Define before including,
+//! e.g. as an assert(), to catch an undersized pool.
+#ifndef SIM_DATAREF_FULL
+#define SIM_DATAREF_FULL(ident)
+#endif
+
+
+/*! \def SIM_DATAREF_TABLE(table, LIST)
+ *  Packed table of dataref identifiers in program memory.
+ *  Each identifier takes only its own length plus one byte, rather than
+ *  the width of a DataRefIdent name[][64] array, and is reached by name
+ *  as table.name. LIST is a macro applying its argument to each name and
+ *  identifier; a shared prefix can be a macro pasted onto each literal.
+ *  \code
+ *  #define ANNC "sim/cockpit2/annunciators/"
+ *  #define ELEC_REFS(X) \
+ *    X(lowVolts, ANNC "low_voltage") \
+ *    X(genOff0,  ANNC "generator_off[0]")
+ *  SIM_DATAREF_TABLE(elecRefs, ELEC_REFS);
+ *
+ *  SimLEDIntDR elecLowVolts(-1, elecRefs.lowVolts);
+ *  \endcode
+ *  The identifiers must stay whole in program memory, as Teensyduino
+ *  reads them from there whenever it identifies to X-Plane.
+ */
+#define SIM_DATAREF_FIELD(name, ident) char name[sizeof(ident)];
+#define SIM_DATAREF_VALUE(name, ident) ident,
+#define SIM_DATAREF_TABLE(table, LIST) \
+  struct table##_t { LIST(SIM_DATAREF_FIELD) }; \
+  PROGMEM const table##_t table = { LIST(SIM_DATAREF_VALUE) }
+
+
+/*! \def SIM_DATAREF_ARRAY(name, ident, N)
+ *  Identifiers of elements 0 to N-1 of array dataref ident, as a
+ *  DataRefIdent name[N][] built when compiling. N must be a literal
+ *  number from 1 to 8. For SimLEDIntArrayDR and friends:
+ *  \code
+ *  SIM_DATAREF_ARRAY(oilPressIdent, ANNC "oil_pressure_low", 2);
+ *  // "sim/cockpit2/annunciators/oil_pressure_low[0]", "...[1]"
+ *  \endcode
+ */
+#define SIM_DATAREF_ARRAY(name, ident, N) \
+  DataRefIdent name[N][sizeof(ident "[" #N "]")] = \
+    { SIM_DATAREF_ELEMENTS_##N(ident) }
+#define SIM_DATAREF_ELEMENTS_1(ident) ident "[0]"
+#define SIM_DATAREF_ELEMENTS_2(ident) \
+  SIM_DATAREF_ELEMENTS_1(ident), ident "[1]"
+#define SIM_DATAREF_ELEMENTS_3(ident) \
+  SIM_DATAREF_ELEMENTS_2(ident), ident "[2]"
+#define SIM_DATAREF_ELEMENTS_4(ident) \
+  SIM_DATAREF_ELEMENTS_3(ident), ident "[3]"
+#define SIM_DATAREF_ELEMENTS_5(ident) \
+  SIM_DATAREF_ELEMENTS_4(ident), ident "[4]"
+#define SIM_DATAREF_ELEMENTS_6(ident) \
+  SIM_DATAREF_ELEMENTS_5(ident), ident "[5]"
+#define SIM_DATAREF_ELEMENTS_7(ident) \
+  SIM_DATAREF_ELEMENTS_6(ident), ident "[6]"
+#define SIM_DATAREF_ELEMENTS_8(ident) \
+  SIM_DATAREF_ELEMENTS_7(ident), ident "[7]"
+
+//! Registry of the datarefs used by SimObjects, keyed by identifier.
+/*! The first request for an identifier takes a dataref from the pool;
+ *  later requests for the same text get the same dataref, whether or
+ *  not they pass the same DataRefIdent. The pool holds SIM_DATAREF_INTS
+ *  and SIM_DATAREF_FLOATS datarefs, which the sketch defines to fit its
+ *  panel. Beyond that, SIM_DATAREF_FULL() is called and each request
+ *  gets a dataref of its own from the heap, subscribed at once and not
+ *  shared. The panel still works, but costs more RAM than it need, so
+ *  such requests are counted by overflow() for setup() to report:
+ *  \code
+ *  #define SIM_DATAREF_INTS 12
+ *  #define SIM_DATAREF_FLOATS 2
+ *  #include <SimObjectsDev.h>
+ *  ...
+ *  if (SimDataRefs::overflow() != 0)
+ *    SimDataRefs::report(Serial);
+ *  \endcode
+ *
+ *  Datarefs are only subscribed, so that X-Plane starts sending them,
+ *  when subscribe() is first called for them. SimObjects do this the
+ *  first time they update with simulated power, so a cold-and-dark
+ *  panel asks for almost nothing. setLazy(false) subscribes on request
+ *  instead.*/
+class SimDataRefs {
+public:
+  //! Shared integer dataref for ident
+  static FlightSimInteger &intRef(const char *ident);
+
+  //! Shared float dataref for ident
+  static FlightSimFloat &floatRef(const char *ident);
+
+  //! Have X-Plane start sending dr, if it has not already
+  static void subscribe(FlightSimInteger &dr);
+  static void subscribe(FlightSimFloat &dr);
+
+  //! Wait for subscribe() (default), or subscribe on request.
+  //! Call before any dataref objects are constructed.
+  static void setLazy(bool lazy) { _lazy = lazy; }
+
+  //! Number of distinct datarefs requested
+  static unsigned int unique(void) { return _intsUsed + _floatsUsed; }
+
+  //! Number of datarefs subscribed so far
+  static unsigned int subscribed(void) { return _subscribed; }
+
+  //! Number of intRef() and floatRef() calls
+  static unsigned int requests(void) { return _requests; }
+
+  //! Number of requests given their own dataref as the pool was full
+  static unsigned int overflow(void) { return _overflow; }
+
+  //! Print the counts and the identifiers subscribed
+  static void report(Print &out);
+
+private:
+  //! True if two identifiers, both in program memory, match
+  static bool _sameIdent(const char *a, const char *b);
+
+  static void _printIdent(Print &out, const char *ident);
+
+  static FlightSimInteger _ints[SIM_DATAREF_INTS];
+  static const char *_intIdents[SIM_DATAREF_INTS];
+  static unsigned char _intsUsed;
+  static SimBits<SIM_DATAREF_INTS> _intsSubscribed;
+
+  static FlightSimFloat _floats[SIM_DATAREF_FLOATS];
+  static const char *_floatIdents[SIM_DATAREF_FLOATS];
+  static unsigned char _floatsUsed;
+  static SimBits<SIM_DATAREF_FLOATS> _floatsSubscribed;
+
+  static bool _lazy;
+  static unsigned int _subscribed;
+
+  static unsigned int _requests;
+  static unsigned int _overflow;
+};
+
+
+FlightSimInteger SimDataRefs::_ints[SIM_DATAREF_INTS];
+const char *SimDataRefs::_intIdents[SIM_DATAREF_INTS];
+unsigned char SimDataRefs::_intsUsed = 0;
+SimBits<SIM_DATAREF_INTS> SimDataRefs::_intsSubscribed;
+
+FlightSimFloat SimDataRefs::_floats[SIM_DATAREF_FLOATS];
+const char *SimDataRefs::_floatIdents[SIM_DATAREF_FLOATS];
+unsigned char SimDataRefs::_floatsUsed = 0;
+SimBits<SIM_DATAREF_FLOATS> SimDataRefs::_floatsSubscribed;
+
+bool SimDataRefs::_lazy = true;
+unsigned int SimDataRefs::_subscribed = 0;
+
+unsigned int SimDataRefs::_requests = 0;
+unsigned int SimDataRefs::_overflow = 0;
+
+
+
+bool SimDataRefs::_sameIdent(const char *a, const char *b) {
+  if (a == b)
+    return true;
+  for (;; ++a, ++b) {
+    unsigned char c = pgm_read_byte(a);
+    if (c != pgm_read_byte(b))
+      return false;
+    if (c == 0)
+      return true;
+  }
+}
+
+
+FlightSimInteger &SimDataRefs::intRef(const char *ident) {
+  ++_requests;
+  for (unsigned char i = 0; i < _intsUsed; ++i) {
+    if (_sameIdent(_intIdents[i], ident))
+      return _ints[i];
+  }
+  if (_intsUsed >= SIM_DATAREF_INTS) {
+    // a dataref of its own, as before pooling: only sharing is lost
+    SIM_DATAREF_FULL(ident);
+    ++_overflow;
+    ++_subscribed;
+    FlightSimInteger *dr = new FlightSimInteger;
+    dr->assign((const _XpRefStr_ *) ident);
+    return *dr;
+  }
+  _intIdents[_intsUsed] = ident;
+  FlightSimInteger &dr = _ints[_intsUsed++];
+  if (!_lazy)
+    subscribe(dr);
+  return dr;
+}
+
+
+FlightSimFloat &SimDataRefs::floatRef(const char *ident) {
+  ++_requests;
+  for (unsigned char i = 0; i < _floatsUsed; ++i) {
+    if (_sameIdent(_floatIdents[i], ident))
+      return _floats[i];
+  }
+  if (_floatsUsed >= SIM_DATAREF_FLOATS) {
+    SIM_DATAREF_FULL(ident);
+    ++_overflow;
+    ++_subscribed;
+    FlightSimFloat *dr = new FlightSimFloat;
+    dr->assign((const _XpRefStr_ *) ident);
+    return *dr;
+  }
+  _floatIdents[_floatsUsed] = ident;
+  FlightSimFloat &dr = _floats[_floatsUsed++];
+  if (!_lazy)
+    subscribe(dr);
+  return dr;
+}
+
+
+void SimDataRefs::subscribe(FlightSimInteger &dr) {
+  // datarefs outside the pool were subscribed when made
+  if (&dr < _ints || &dr >= _ints + _intsUsed)
+    return;
+  unsigned char i = &dr - _ints;
+  if (_intsSubscribed.test(i))
+    return;
+  _intsSubscribed.set(i);
+  ++_subscribed;
+  dr.assign((const _XpRefStr_ *) _intIdents[i]);
+}
+
+
+void SimDataRefs::subscribe(FlightSimFloat &dr) {
+  if (&dr < _floats || &dr >= _floats + _floatsUsed)
+    return;
+  unsigned char i = &dr - _floats;
+  if (_floatsSubscribed.test(i))
+    return;
+  _floatsSubscribed.set(i);
+  ++_subscribed;
+  dr.assign((const _XpRefStr_ *) _floatIdents[i]);
+}
+
+
+void SimDataRefs::_printIdent(Print &out, const char *ident) {
+  for (unsigned char c; (c = pgm_read_byte(ident)) != 0; ++ident)
+    out.print((char)c);
+}
+
+
+void SimDataRefs::report(Print &out) {
+  out.print(F("datarefs unique="));
+  out.print(unique());
+  out.print(F(" subscribed="));
+  out.print(subscribed());
+  out.print(F(" requests="));
+  out.print(requests());
+  out.print(F(" overflow="));
+  out.println(overflow());
+  for (unsigned char i = 0; i < _intsUsed; ++i) {
+    out.print(F("  int   "));
+    _printIdent(out, _intIdents[i]);
+    out.println();
+  }
+  for (unsigned char i = 0; i < _floatsUsed; ++i) {
+    out.print(F("  float "));
+    _printIdent(out, _floatIdents[i]);
+    out.println();
+  }
+}
+
+
+#endif // SIMDATAREFDEV_H
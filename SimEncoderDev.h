@@ -0,0 +1,337 @@
+
+// SimEncoder Development Version
+
+/*
+     * Copyright 2012 Jack Deeth
+     * Contact: simulationelectronics@gmail.com
+     *
+     * Rotary encoders for heading, course and altitude knobs, decoded by
+     * pin-change interrupt so no detents are lost during a long loop(),
+     * and sent to X-Plane once per SimObject::update().
+     *
+     * This program is free software: you can redistribute it and/or modify
+     * it under the terms of the GNU Lesser General Public License as
+     * published by the Free Software Foundation, either version 3 of the
+     * License, or (at your option) any later version.
+     *
+     * This program is distributed in the hope that it will be useful,
+     * but WITHOUT ANY WARRANTY; without even the implied warranty of
+     * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+     * GNU Lesser General Public License for more details.
+     *
+     * You should have received a copy of the GNU Lesser General Public
+     * License along with this program.
+     * If not, see <http://www.gnu.org/licenses/>.
+     *
+     * I would appreciate, but not insist, on attribution if this code is
+     * incorporated into other projects.
+     */
+
+#ifndef SIMENCODERDEV_H
+#define SIMENCODERDEV_H
+
+#include "SimObjectsDev.h"
+#include "SimDataRefDev.h"
+
+//! Most SimEncoders decoded by interrupt. Others are polled.
+#define SIM_MAX_ENCODER_ISRS 8
+
+
+//! A quadrature rotary encoder, turning a dataref, commands or a function.
+/*! Both pins are decoded by pin-change interrupt where the board has
+ *  one, so steps are counted however long loop() takes. Each
+ *  SimObject::update() then takes the whole detents turned since the
+ *  last, and sends them at once: one dataref write, or a burst of
+ *  commands in the same USB frame, however many clicks it was. Pins
+ *  without an interrupt (only a few have one on AVR Teensys) are polled
+ *  from update() instead, which can miss steps when the loop is slow.
+ *
+ *  Encoders are read in the sample phase, with the SimSwitchBanks.
+ *  \code
+ *  DataRefIdent hdgIdent[] = "sim/cockpit/autopilot/heading_mag";
+ *  DataRefIdent altUpIdent[] = "sim/autopilot/altitude_up";
+ *  DataRefIdent altDownIdent[] = "sim/autopilot/altitude_down";
+ *
+ *  // heading bug, one degree a click, 0 to 360 and round again
+ *  SimEncoder hdgKnob(2, 3, hdgIdent, 1, 0, 360, true);
+ *  // altitude by command, ten times as fast when spun
+ *  SimEncoder altKnob(5, 6, altUpIdent, altDownIdent);
+ *  ...
+ *  altKnob.setAcceleration(10, 8);
+ *  \endcode
+ */
+class SimEncoder : public SimObject {
+public:
+  //! Add step to the float dataref ident per detent, keeping it from
+  //! minimum to maximum, or wrapping round within them if wrap is set.
+  //! ident is a DataRefIdent, or from SIM_DATAREF_TABLE, in program
+  //! memory.
+  //! \param pinA, pinB Encoder pins, closing to ground
+  //! \param stepsPerDetent Quadrature steps per click: 4 for most
+  //!        encoders, 2 or 1 for some
+  SimEncoder(int pinA, int pinB, const char *ident, float step,
+             float minimum, float maximum, bool wrap = false,
+             unsigned char stepsPerDetent = 4) :
+    SimObject(0),
+    _dr(&SimDataRefs::floatRef(ident)),
+    _step(step),
+    _minimum(minimum),
+    _maximum(maximum),
+    _wrap(wrap),
+    _up(0),
+    _down(0),
+    _onTurn(0)
+  { _init(pinA, pinB, stepsPerDetent); }
+
+  //! Run command up once per detent clockwise, and down once per detent
+  //! anticlockwise. Both identifiers are in program memory, as above.
+  SimEncoder(int pinA, int pinB, const char *up, const char *down,
+             unsigned char stepsPerDetent = 4) :
+    SimObject(0),
+    _dr(0),
+    _step(1),
+    _minimum(0),
+    _maximum(0),
+    _wrap(false),
+    _up(up),
+    _down(down),
+    _onTurn(0)
+  { _init(pinA, pinB, stepsPerDetent); }
+
+  //! Call onTurn(detents) when turned, positive clockwise
+  SimEncoder(int pinA, int pinB, void (*onTurn)(int detents),
+             unsigned char stepsPerDetent = 4) :
+    SimObject(0),
+    _dr(0),
+    _step(1),
+    _minimum(0),
+    _maximum(0),
+    _wrap(false),
+    _up(0),
+    _down(0),
+    _onTurn(onTurn)
+  { _init(pinA, pinB, stepsPerDetent); }
+
+  ~SimEncoder() {
+    if (_slot < SIM_MAX_ENCODER_ISRS)
+      _slots[_slot] = 0;
+  }
+
+  //! Multiply turns by up to maxFactor when spun quickly.
+  /*! Turning at rate detents per second doubles each detent, twice that
+   *  trebles it, and so on up to maxFactor. 1 (the default) turns off
+   *  acceleration.*/
+  void setAcceleration(unsigned char maxFactor, unsigned int rate) {
+    _maxFactor = maxFactor ? maxFactor : 1;
+    _rate = rate ? rate : 1;
+  }
+
+  //! Swap clockwise and anticlockwise
+  void reverse(bool reversed) { _reversed = reversed; }
+
+  //! Detents turned at the last update, after acceleration
+  int lastTurn(void) const { return _lastTurn; }
+
+  //! True if the encoder is decoded by interrupt rather than polled
+  bool interruptDriven(void) const { return _slot < SIM_MAX_ENCODER_ISRS; }
+
+private:
+  FlightSimFloat *_dr;
+  float _step;
+  float _minimum;
+  float _maximum;
+  bool _wrap;
+
+  const char *_up;
+  const char *_down;
+  FlightSimCommand _upCommand;
+  FlightSimCommand _downCommand;
+
+  void (*_onTurn)(int detents);
+
+  int _pinA;
+  int _pinB;
+  unsigned char _portA, _maskA;
+  unsigned char _portB, _maskB;
+  unsigned char _stepsPerDetent;
+  bool _reversed;
+
+  //! Pin levels at the last step, A in bit 1 and B in bit 0
+  volatile unsigned char _ab;
+
+  //! Quadrature steps counted and not yet sent
+  volatile int _steps;
+
+  unsigned char _maxFactor;
+  unsigned int _rate;
+
+  //! Time of the last turn, for acceleration
+  unsigned long _lastMillis;
+
+  int _lastTurn;
+
+  //! Interrupt slot, or SIM_MAX_ENCODER_ISRS if polled
+  unsigned char _slot;
+
+  void _init(int pinA, int pinB, unsigned char stepsPerDetent) {
+    _pinA = pinA;
+    _pinB = pinB;
+    _portA = _maskA = _portB = _maskB = 0;
+    _stepsPerDetent = stepsPerDetent ? stepsPerDetent : 1;
+    _reversed = false;
+    _ab = 0;
+    _steps = 0;
+    _maxFactor = 1;
+    _rate = 1;
+    _lastMillis = 0;
+    _lastTurn = 0;
+    _slot = SIM_MAX_ENCODER_ISRS;
+    setPriority(PriorityCritical);
+    _addToGroup(_typeGroup);
+  }
+
+  //! Pin levels now, A in bit 1 and B in bit 0
+  unsigned char _readPins(void) {
+    return ((SimHAL::readPortBits(_portA) & _maskA) ? 2 : 0)
+         | ((SimHAL::readPortBits(_portB) & _maskB) ? 1 : 0);
+  }
+
+  //! Count the step, if any, since the last call
+  void _decode(void) {
+    // +1 or -1 for each Gray code step; 0 for none, or a missed step
+    static const signed char transition[16] = {
+       0, -1,  1,  0,
+       1,  0,  0, -1,
+      -1,  0,  0,  1,
+       0,  1, -1,  0
+    };
+    unsigned char ab = _readPins();
+    _steps += transition[(_ab << 2) | ab];
+    _ab = ab;
+  }
+
+  //! Encoders decoded by interrupt, and a handler for each
+  static SimEncoder *_slots[SIM_MAX_ENCODER_ISRS];
+  template <unsigned char I>
+  static void _isr(void) {
+    if (_slots[I] != 0)
+      _slots[I]->_decode();
+  }
+  static void (*_isrFor(unsigned char slot))(void);
+
+  void _setup(void);
+  void _update(bool updateOutput = true);
+
+  friend class SimObject;
+  static SimGroup _typeGroup;
+  void _updateDirect(bool updateOutput) { SimEncoder::_update(updateOutput); }
+};
+
+
+// read with the switches, before anything else
+SimGroup SimEncoder::_typeGroup = SIM_GROUP(SimEncoder, SimObject::LevelSwitch);
+SimEncoder *SimEncoder::_slots[SIM_MAX_ENCODER_ISRS];
+
+
+void (*SimEncoder::_isrFor(unsigned char slot))(void) {
+  switch (slot) {
+    case 0:  return &SimEncoder::_isr<0>;
+    case 1:  return &SimEncoder::_isr<1>;
+    case 2:  return &SimEncoder::_isr<2>;
+    case 3:  return &SimEncoder::_isr<3>;
+    case 4:  return &SimEncoder::_isr<4>;
+    case 5:  return &SimEncoder::_isr<5>;
+    case 6:  return &SimEncoder::_isr<6>;
+    default: return &SimEncoder::_isr<7>;
+  }
+}
+
+
+void SimEncoder::_setup(void) {
+  if (!SimHAL::pinPort(_pinA, _portA, _maskA)
+      || !SimHAL::pinPort(_pinB, _portB, _maskB))
+    return;
+  SimHAL::inputPortBits(_portA, _maskA, true);
+  SimHAL::inputPortBits(_portB, _maskB, true);
+  _ab = _readPins();
+
+  if (_up != 0) {
+    _upCommand.assign((const _XpRefStr_ *) _up);
+    _downCommand.assign((const _XpRefStr_ *) _down);
+  }
+  if (_dr != 0)
+    SimDataRefs::subscribe(*_dr);
+
+  // take a free interrupt slot, if both pins have an interrupt
+  if (_slot < SIM_MAX_ENCODER_ISRS)
+    return;
+  unsigned char slot = 0;
+  while (slot < SIM_MAX_ENCODER_ISRS && _slots[slot] != 0)
+    ++slot;
+  if (slot == SIM_MAX_ENCODER_ISRS)
+    return;
+  _slots[slot] = this;
+  if (SimHAL::pinChangeBegin(_pinA, _isrFor(slot))
+      && SimHAL::pinChangeBegin(_pinB, _isrFor(slot)))
+    _slot = slot;
+  else {
+    // polled after all; the handler ignores the empty slot
+    _slots[slot] = 0;
+  }
+}
+
+
+void SimEncoder::_update(bool /*updateOutput*/) {
+  if (_slot == SIM_MAX_ENCODER_ISRS)
+    _decode();
+
+  // take whole detents, leaving any part-turn for next time
+  unsigned char state = SimHAL::interruptsHold();
+  int detents = _steps / _stepsPerDetent;
+  _steps -= detents * _stepsPerDetent;
+  SimHAL::interruptsRelease(state);
+
+  _lastTurn = 0;
+  if (detents == 0)
+    return;
+  if (_reversed)
+    detents = -detents;
+
+  if (_maxFactor > 1) {
+    unsigned long now = SimHAL::millisNow();
+    unsigned long elapsed = now - _lastMillis;
+    _lastMillis = now;
+    unsigned long speed = (unsigned long)(detents < 0 ? -detents : detents)
+                          * 1000UL / (elapsed ? elapsed : 1);
+    unsigned long factor = 1 + speed / _rate;
+    detents *= (int)(factor < _maxFactor ? factor : _maxFactor);
+  }
+  _lastTurn = detents;
+
+  if (_dr != 0) {
+    float value = (float)*_dr + detents * _step;
+    if (_wrap && _maximum > _minimum) {
+      float range = _maximum - _minimum;
+      while (value >= _maximum)
+        value -= range;
+      while (value < _minimum)
+        value += range;
+    } else if (value > _maximum)
+      value = _maximum;
+    else if (value < _minimum)
+      value = _minimum;
+    _dr->write(value);
+  }
+  if (_up != 0) {
+    // all in this pass, so they share a USB frame
+    for (int n = detents; n > 0; --n)
+      _upCommand.once();
+    for (int n = detents; n < 0; ++n)
+      _downCommand.once();
+  }
+  if (_onTurn != 0)
+    _onTurn(detents);
+}
+
+
+#endif // SIMENCODERDEV_H
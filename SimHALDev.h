@@ -0,0 +1,271 @@
+// SimHAL Development Version
+
+/*
+     * Copyright 2012 Jack Deeth
+     * Contact: simulationelectronics@gmail.com
+     *
+     * Hardware abstraction layer for SimObjects. Selects the board
+     * backend and provides the small set of hardware calls the
+     * SimObjects classes make.
+     *
+     * This program is free software: you can redistribute it and/or modify
+     * it under the terms of the GNU Lesser General Public License as
+     * published by the Free Software Foundation, either version 3 of the
+     * License, or (at your option) any later version.
+     *
+     * This program is distributed in the hope that it will be useful,
+     * but WITHOUT ANY WARRANTY; without even the implied warranty of
+     * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+     * GNU Lesser General Public License for more details.
+     *
+     * You should have received a copy of the GNU Lesser General Public
+     * License along with this program.
+     * If not, see <http://www.gnu.org/licenses/>.
+     *
+     * I would appreciate, but not insist, on attribution if this code is
+     * incorporated into other projects.
+     */
+
+#ifndef SIMHALDEV_H
+#define SIMHALDEV_H
+
+// Backend selection:
+//
+// SIMOBJECTS_HOST        in-memory desktop backend (SimHALHost.h) for
+//                        building, profiling and testing on a PC
+// SIMOBJECTS_HAL_HEADER  name of a header providing your own backend,
+//                        e.g. -DSIMOBJECTS_HAL_HEADER='"MyBoard.h"'
+// (neither)              Arduino/Teensyduino
+//
+// A backend must provide the Arduino digital I/O and timing calls,
+// Servo, FlightSim, FlightSimInteger and FlightSimFloat.
+#if defined(SIMOBJECTS_HOST)
+#include "SimHALHost.h"
+#elif defined(SIMOBJECTS_HAL_HEADER)
+#include SIMOBJECTS_HAL_HEADER
+#elif defined(ARDUINO) && ARDUINO >= 100
+#include "Arduino.h"
+#elif defined(WIRING)
+#include "Wiring.h"
+#else
+#include "WProgram.h"
+#include "pins_arduino.h"
+#endif
+
+
+//! Hardware calls made by SimObjects.
+/*! All SimObjects classes reach the hardware through these functions
+ *  rather than calling the Arduino API directly, so that only this
+ *  file needs to know which backend is in use.
+ */
+namespace SimHAL {
+
+//! Make pin an output. Negative pin numbers mean "not connected".
+inline void outputPin(int pin) {
+  if (pin >= 0)
+    pinMode(pin, OUTPUT);
+}
+
+//! Drive pin high or low. Negative pin numbers are ignored.
+inline void writePin(int pin, bool state) {
+  if (pin >= 0)
+    digitalWrite(pin, state ? HIGH : LOW);
+}
+
+//! Find the 8-bit output port and bit mask driving a pin.
+/*! On AVR these are the chip's own I/O ports. Elsewhere a "port" is
+ *  eight consecutive pin numbers. Returns false if pin is not connected.
+ */
+inline bool pinPort(int pin, unsigned char &port, unsigned char &mask) {
+  if (pin < 0)
+    return false;
+#if defined(__AVR__) && !defined(SIMOBJECTS_HOST) \
+                     && !defined(SIMOBJECTS_HAL_HEADER)
+  port = digitalPinToPort(pin);
+  mask = digitalPinToBitMask(pin);
+#ifdef NOT_A_PIN
+  if (port == NOT_A_PIN)
+    return false;
+#endif
+#else
+  port = pin >> 3;
+  mask = 1 << (pin & 7);
+#endif
+  return true;
+}
+
+//! Make the pins of port selected by mask outputs
+inline void outputPortBits(unsigned char port, unsigned char mask) {
+#if defined(__AVR__) && !defined(SIMOBJECTS_HOST) \
+                     && !defined(SIMOBJECTS_HAL_HEADER)
+  volatile uint8_t *ddr = portModeRegister(port);
+  uint8_t oldSREG = SREG;
+  cli();
+  *ddr |= mask;
+  SREG = oldSREG;
+#else
+  for (int bit = 0; bit < 8; ++bit) {
+    if (mask & (1 << bit))
+      pinMode((port << 3) + bit, OUTPUT);
+  }
+#endif
+}
+
+//! Set the pins of port selected by mask to the matching bits of bits.
+/*! Other pins on the port are left alone. On AVR this is one
+ *  read-modify-write of the port register with interrupts held off, so
+ *  pins changed by interrupt handlers (e.g. Servo) are not disturbed.
+ */
+inline void writePortBits(unsigned char port, unsigned char mask,
+                          unsigned char bits) {
+#if defined(SIMOBJECTS_HOST)
+  SimHost::writePort(port, mask, bits);
+#elif defined(__AVR__) && !defined(SIMOBJECTS_HAL_HEADER)
+  volatile uint8_t *out = portOutputRegister(port);
+  uint8_t oldSREG = SREG;
+  cli();
+  *out = (*out & ~mask) | (bits & mask);
+  SREG = oldSREG;
+#else
+  for (int bit = 0; bit < 8; ++bit) {
+    if (mask & (1 << bit))
+      digitalWrite((port << 3) + bit, (bits & (1 << bit)) ? HIGH : LOW);
+  }
+#endif
+}
+
+//! Make the pins of port selected by mask inputs, with pull-up
+//! resistors if pullup is set
+inline void inputPortBits(unsigned char port, unsigned char mask,
+                          bool pullup) {
+#if defined(__AVR__) && !defined(SIMOBJECTS_HOST) \
+                     && !defined(SIMOBJECTS_HAL_HEADER)
+  volatile uint8_t *ddr = portModeRegister(port);
+  volatile uint8_t *out = portOutputRegister(port);
+  uint8_t oldSREG = SREG;
+  cli();
+  *ddr &= ~mask;
+  if (pullup)
+    *out |= mask;
+  else
+    *out &= ~mask;
+  SREG = oldSREG;
+#else
+  for (int bit = 0; bit < 8; ++bit) {
+    if (mask & (1 << bit))
+      pinMode((port << 3) + bit, pullup ? INPUT_PULLUP : INPUT);
+  }
+#endif
+}
+
+//! Levels of all eight pins of port, one bit each.
+/*! On AVR this is a single read of the port's input register.*/
+inline unsigned char readPortBits(unsigned char port) {
+#if defined(SIMOBJECTS_HOST)
+  return SimHost::readPort(port);
+#elif defined(__AVR__) && !defined(SIMOBJECTS_HAL_HEADER)
+  return *portInputRegister(port);
+#else
+  unsigned char bits = 0;
+  for (int bit = 0; bit < 8; ++bit) {
+    if (digitalRead((port << 3) + bit))
+      bits |= 1 << bit;
+  }
+  return bits;
+#endif
+}
+
+//! ADC reading of an analog pin, 0 to 1023. Negative pins read 0.
+inline int readAnalog(int pin) {
+  if (pin < 0)
+    return 0;
+  return analogRead(pin);
+}
+
+//! Call isr from an interrupt whenever pin changes level.
+/*! Returns false if the pin has no such interrupt, or the board's core
+ *  does not say which pins do.*/
+inline bool pinChangeBegin(int pin, void (*isr)(void)) {
+#if defined(SIMOBJECTS_HOST)
+  if (pin < 0 || pin >= SIMHOST_NUM_PINS)
+    return false;
+  SimHost::pinIsrs[pin] = isr;
+  return true;
+#elif defined(digitalPinToInterrupt) && defined(CHANGE)
+  if (pin < 0)
+    return false;
+  int irq = digitalPinToInterrupt(pin);
+#ifdef NOT_AN_INTERRUPT
+  if (irq == NOT_AN_INTERRUPT)
+    return false;
+#endif
+  if (irq < 0)
+    return false;
+  attachInterrupt(irq, isr, CHANGE);
+  return true;
+#else
+  (void)pin;
+  (void)isr;
+  return false;
+#endif
+}
+
+//! Hold off interrupts while reading data they change. Pass the value
+//! returned to interruptsRelease().
+inline unsigned char interruptsHold(void) {
+#if defined(SIMOBJECTS_HOST)
+  return 0;
+#elif defined(__AVR__)
+  unsigned char state = SREG;
+  cli();
+  return state;
+#else
+  noInterrupts();
+  return 0;
+#endif
+}
+
+//! End interruptsHold()
+inline void interruptsRelease(unsigned char state) {
+#if defined(SIMOBJECTS_HOST)
+  (void)state;
+#elif defined(__AVR__)
+  SREG = state;
+#else
+  (void)state;
+  interrupts();
+#endif
+}
+
+//! True if X-Plane is connected and sending data
+inline bool simEnabled(void) { return FlightSim.isEnabled(); }
+
+//! Microsecond timestamp, wrapping as Arduino micros() does
+inline unsigned long microsNow(void) { return micros(); }
+
+//! Millisecond timestamp, wrapping as Arduino millis() does
+inline unsigned long millisNow(void) { return millis(); }
+
+// Timestamps for SIMOBJECTS_PROFILE: CPU cycles on ARM Teensys, which
+// count them, otherwise microseconds.
+#if defined(ARM_DWT_CYCCNT)
+#define SIMHAL_PROFILE_UNIT "cycles"
+
+//! Start the cycle counter
+inline void profileBegin(void) {
+  ARM_DEMCR |= ARM_DEMCR_TRCENA;
+  ARM_DWT_CTRL |= ARM_DWT_CTRL_CYCCNTENA;
+}
+
+inline unsigned long profileNow(void) { return ARM_DWT_CYCCNT; }
+#else
+#define SIMHAL_PROFILE_UNIT "us"
+
+inline void profileBegin(void) {}
+
+inline unsigned long profileNow(void) { return micros(); }
+#endif
+
+} // namespace SimHAL
+
+#endif // SIMHALDEV_H
@@ -0,0 +1,610 @@
+// SimHAL host backend, Development Version
+
+/*
+     * Copyright 2012 Jack Deeth
+     * Contact: simulationelectronics@gmail.com
+     *
+     * In-memory stand-ins for the Arduino core, Servo and Teensyduino
+     * FlightSim classes, so SimObjects sketches can be built and run on
+     * a desktop (Linux) machine for profiling and regression testing.
+     *
+     * Enable with -DSIMOBJECTS_HOST. For example, to run the b737Anncs
+     * example for 1000 loops:
+     *
+     *   g++ -DSIMOBJECTS_HOST -DSIMOBJECTS_HOST_MAIN -I. -Iextras/host \
+     *       -x c++ examples/b737Anncs/b737Anncs.pde -o b737Anncs
+     *   ./b737Anncs 1000
+     *
+     * This program is free software: you can redistribute it and/or modify
+     * it under the terms of the GNU Lesser General Public License as
+     * published by the Free Software Foundation, either version 3 of the
+     * License, or (at your option) any later version.
+     *
+     * This program is distributed in the hope that it will be useful,
+     * but WITHOUT ANY WARRANTY; without even the implied warranty of
+     * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+     * GNU Lesser General Public License for more details.
+     *
+     * You should have received a copy of the GNU Lesser General Public
+     * License along with this program.
+     * If not, see <http://www.gnu.org/licenses/>.
+     *
+     * I would appreciate, but not insist, on attribution if this code is
+     * incorporated into other projects.
+     */
+
+#ifndef SIMHALHOST_H
+#define SIMHALHOST_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef bool    boolean;
+typedef uint8_t byte;
+
+#define HIGH 1
+#define LOW  0
+
+#define INPUT        0
+#define OUTPUT       1
+#define INPUT_PULLUP 2
+
+// Program memory is ordinary memory on the host
+#define PROGMEM
+#define PSTR(s) (s)
+#define pgm_read_byte(addr) (*(const unsigned char *)(addr))
+
+//! Number of simulated digital pins
+#ifndef SIMHOST_NUM_PINS
+#define SIMHOST_NUM_PINS 64
+#endif
+
+//! Number of identifiers whose values the simulated X-Plane remembers
+#ifndef SIMHOST_NUM_DATAREFS
+#define SIMHOST_NUM_DATAREFS 256
+#endif
+
+
+
+class FlightSimInteger;
+class FlightSimFloat;
+
+//! Controls and probes for the simulated board and simulator link.
+namespace SimHost {
+
+//! Pin mode set by pinMode(), per pin
+uint8_t pinModes[SIMHOST_NUM_PINS];
+
+//! Level last written by digitalWrite(), per pin
+uint8_t pinOutputs[SIMHOST_NUM_PINS];
+
+//! Level seen by digitalRead(), per pin. Set with setPin().
+uint8_t pinInputs[SIMHOST_NUM_PINS];
+
+//! Total digitalWrite() calls made
+unsigned long digitalWrites = 0;
+
+//! Total SimHAL::writePortBits() calls made
+unsigned long portWrites = 0;
+
+//! Total SimHAL::readPortBits() calls made
+unsigned long portReads = 0;
+
+//! Value seen by analogRead(), per pin. Set with setAnalog().
+int analogInputs[SIMHOST_NUM_PINS];
+
+//! Total analogRead() calls made
+unsigned long analogReads = 0;
+
+//! FlightSimCommand begin() (or once()) and end() calls made
+unsigned long commandBegins = 0;
+unsigned long commandEnds = 0;
+
+//! Total values written to X-Plane through FlightSimInteger/Float
+unsigned long datarefWrites = 0;
+
+//! Total FlightSimInteger/Float assign() calls, i.e. subscriptions
+unsigned long datarefAssigns = 0;
+
+//! A value set in the simulated X-Plane
+struct DatarefValue {
+  const char *ident;
+  long intValue;
+  float floatValue;
+};
+
+//! Values set with setInt() and setFloat(), sent on subscription
+DatarefValue datarefValues[SIMHOST_NUM_DATAREFS];
+unsigned int datarefValueCount = 0;
+
+//! Stored value for ident, or 0 if none. Adds an entry if create is set.
+inline DatarefValue *datarefValue(const char *ident, bool create) {
+  for (unsigned int i = 0; i < datarefValueCount; ++i) {
+    if (strcmp(datarefValues[i].ident, ident) == 0)
+      return &datarefValues[i];
+  }
+  if (!create || datarefValueCount >= SIMHOST_NUM_DATAREFS)
+    return 0;
+  DatarefValue &v = datarefValues[datarefValueCount++];
+  v.ident = strdup(ident);
+  v.intValue = 0;
+  v.floatValue = 0;
+  return &v;
+}
+
+//! Whether the simulated X-Plane link is up
+bool simEnabled = true;
+
+//! Frames counted by FlightSim.update()
+unsigned long frameCount = 0;
+
+//! If true, micros() and millis() only move when advanceMicros() is called
+bool fakeClock = false;
+
+//! Current time of the fake clock
+unsigned long fakeMicros = 0;
+
+//! Pin-change interrupt handler per pin, see SimHAL::pinChangeBegin()
+void (*pinIsrs[SIMHOST_NUM_PINS])(void);
+
+//! Set the level digitalRead() will report for a pin. Runs the pin's
+//! change interrupt handler, if any, when the level changes.
+inline void setPin(int pin, bool level) {
+  if (pin >= 0 && pin < SIMHOST_NUM_PINS) {
+    bool changed = (pinInputs[pin] != 0) != level;
+    pinInputs[pin] = level;
+    if (changed && pinIsrs[pin] != 0)
+      pinIsrs[pin]();
+  }
+}
+
+//! Set the value analogRead() will report for a pin, 0 to 1023
+inline void setAnalog(int pin, int value) {
+  if (pin >= 0 && pin < SIMHOST_NUM_PINS)
+    analogInputs[pin] = value < 0 ? 0 : value > 1023 ? 1023 : value;
+}
+
+//! Level most recently written to an output pin
+inline bool pin(int pin) {
+  if (pin >= 0 && pin < SIMHOST_NUM_PINS)
+    return pinOutputs[pin];
+  return false;
+}
+
+//! Connect or disconnect the simulated X-Plane link
+inline void setEnabled(bool enabled) { simEnabled = enabled; }
+
+//! Switch between wall-clock time and a manually-advanced clock
+inline void useFakeClock(bool fake) { fakeClock = fake; fakeMicros = 0; }
+
+//! False to act as a board without a timer SimObjects can use
+bool timerPresent = true;
+
+//! Interrupt handler started by SimHAL::timerBegin(), or 0
+void (*timerIsr)(void) = 0;
+
+//! Period of timerIsr in microseconds
+unsigned long timerPeriod = 0;
+
+//! Fake clock time at which timerIsr is next due
+unsigned long timerDue = 0;
+
+//! Move the fake clock forward, running timerIsr each time it falls due
+inline void advanceMicros(unsigned long us) {
+  unsigned long end = fakeMicros + us;
+  while (timerIsr != 0 && (long)(end - timerDue) >= 0) {
+    fakeMicros = timerDue;
+    timerDue += timerPeriod;
+    timerIsr();
+  }
+  fakeMicros = end;
+}
+
+//! Run timerIsr count times, whichever clock is in use
+inline void runTimer(unsigned long count) {
+  while (timerIsr != 0 && count-- > 0)
+    timerIsr();
+}
+
+void writePort(uint8_t port, uint8_t mask, uint8_t bits);
+uint8_t readPort(uint8_t port);
+int setInt(const char *ident, long value);
+int setFloat(const char *ident, float value);
+int servoAngle(int pin);
+void dumpState(FILE *out);
+
+} // namespace SimHost
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Arduino core
+
+inline void pinMode(uint8_t pin, uint8_t mode) {
+  if (pin < SIMHOST_NUM_PINS) {
+    SimHost::pinModes[pin] = mode;
+    if (mode == INPUT_PULLUP)
+      SimHost::pinInputs[pin] = HIGH;
+  }
+}
+
+inline void digitalWrite(uint8_t pin, uint8_t val) {
+  ++SimHost::digitalWrites;
+  if (pin < SIMHOST_NUM_PINS)
+    SimHost::pinOutputs[pin] = val ? HIGH : LOW;
+}
+
+//! Write several pins of an 8-pin port at once, as SimHAL::writePortBits()
+void SimHost::writePort(uint8_t port, uint8_t mask, uint8_t bits) {
+  ++portWrites;
+  for (int bit = 0; bit < 8; ++bit) {
+    int pin = (port << 3) + bit;
+    if ((mask & (1 << bit)) && pin < SIMHOST_NUM_PINS)
+      pinOutputs[pin] = (bits & (1 << bit)) ? HIGH : LOW;
+  }
+}
+
+//! Levels of an 8-pin port, as SimHAL::readPortBits()
+uint8_t SimHost::readPort(uint8_t port) {
+  ++portReads;
+  uint8_t bits = 0;
+  for (int bit = 0; bit < 8; ++bit) {
+    int pin = (port << 3) + bit;
+    if (pin < SIMHOST_NUM_PINS && pinInputs[pin])
+      bits |= 1 << bit;
+  }
+  return bits;
+}
+
+inline int digitalRead(uint8_t pin) {
+  if (pin < SIMHOST_NUM_PINS)
+    return SimHost::pinInputs[pin];
+  return LOW;
+}
+
+inline int analogRead(uint8_t pin) {
+  ++SimHost::analogReads;
+  if (pin < SIMHOST_NUM_PINS)
+    return SimHost::analogInputs[pin];
+  return 0;
+}
+
+inline unsigned long micros(void) {
+  if (SimHost::fakeClock)
+    return SimHost::fakeMicros;
+
+  static struct timespec start = { 0, 0 };
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  if (start.tv_sec == 0 && start.tv_nsec == 0)
+    start = ts;
+  return (unsigned long)((ts.tv_sec - start.tv_sec) * 1000000L
+                         + (ts.tv_nsec - start.tv_nsec) / 1000L);
+}
+
+inline unsigned long millis(void) { return micros() / 1000UL; }
+
+inline void delayMicroseconds(unsigned int us) {
+  if (SimHost::fakeClock) {
+    SimHost::advanceMicros(us);
+    return;
+  }
+  unsigned long start = micros();
+  while (micros() - start < us)
+    ;
+}
+
+inline void delay(unsigned long ms) { delayMicroseconds(ms * 1000UL); }
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Print and Serial
+
+#define F(s) (s)
+
+//! Text output, as the Arduino Print class. Writes to stdout.
+class Print {
+public:
+  void print(const char *s)     { fputs(s, stdout); }
+  void print(char c)            { putchar(c); }
+  void print(int n)             { printf("%d", n); }
+  void print(unsigned int n)    { printf("%u", n); }
+  void print(long n)            { printf("%ld", n); }
+  void print(unsigned long n)   { printf("%lu", n); }
+  void print(double n)          { printf("%.2f", n); }
+
+  template <class T>
+  void println(T x)             { print(x); println(); }
+  void println(void)            { putchar('\n'); }
+};
+
+//! USB serial port. begin() does nothing.
+class HardwareSerial : public Print {
+public:
+  void begin(unsigned long) {}
+};
+
+HardwareSerial Serial;
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Servo library
+
+//! Records the angle written to it, per pin.
+class Servo {
+public:
+  Servo() : _pin(-1), _angle(90) {}
+
+  uint8_t attach(int pin) {
+    _pin = pin;
+    if (pin >= 0 && pin < SIMHOST_NUM_PINS)
+      _attached[pin] = true;
+    return 0;
+  }
+  void detach(void) { _pin = -1; }
+  bool attached(void) { return _pin >= 0; }
+  int read(void) { return _angle; }
+
+  void write(int angle) {
+    if (angle < 0)   angle = 0;
+    if (angle > 180) angle = 180;
+    _angle = angle;
+    if (_pin >= 0 && _pin < SIMHOST_NUM_PINS)
+      _angles[_pin] = angle;
+  }
+
+  static int  _angles[SIMHOST_NUM_PINS];
+  static bool _attached[SIMHOST_NUM_PINS];
+
+private:
+  int _pin;
+  int _angle;
+};
+
+int  Servo::_angles[SIMHOST_NUM_PINS];
+bool Servo::_attached[SIMHOST_NUM_PINS];
+
+//! Last angle written to a servo attached to pin
+int SimHost::servoAngle(int pin) {
+  if (pin >= 0 && pin < SIMHOST_NUM_PINS)
+    return Servo::_angles[pin];
+  return -1;
+}
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Teensyduino FlightSim
+
+class _XpRefStr_;
+#define XPlaneRef(str) ((const _XpRefStr_ *)(str))
+
+
+class FlightSimClass {
+public:
+  static bool isEnabled(void) { return SimHost::simEnabled; }
+  static void update(void) { ++SimHost::frameCount; }
+  static unsigned long getFrameCount(void) { return SimHost::frameCount; }
+};
+
+FlightSimClass FlightSim;
+
+
+//! Integer dataref. Values are supplied with SimHost::setInt().
+class FlightSimInteger {
+public:
+  FlightSimInteger() : _name(0), _value(0), _changeCallback(0), _next(0) {
+    if (_last)
+      _last->_next = this;
+    else
+      _first = this;
+    _last = this;
+  }
+
+  ~FlightSimInteger() {
+    FlightSimInteger **link = &_first;
+    FlightSimInteger *prev = 0;
+    while (*link && *link != this) {
+      prev = *link;
+      link = &(*link)->_next;
+    }
+    if (*link)
+      *link = _next;
+    if (_last == this)
+      _last = prev;
+  }
+
+  //! Subscribe. X-Plane sends the current value at once.
+  void assign(const _XpRefStr_ *s) {
+    _name = (const char *)s;
+    ++SimHost::datarefAssigns;
+    SimHost::DatarefValue *v = SimHost::datarefValue(_name, false);
+    if (v != 0)
+      _value = v->intValue;
+  }
+  FlightSimInteger & operator = (const _XpRefStr_ *s) { assign(s); return *this; }
+
+  void write(long val) { _value = val; ++SimHost::datarefWrites; }
+  FlightSimInteger & operator = (int n) { write(n); return *this; }
+
+  int read(void) const { return _value; }
+  operator int () const { return _value; }
+
+  void onChange(void (*fptr)(long)) { _changeCallback = fptr; }
+
+private:
+  const char *_name;
+  long _value;
+  void (*_changeCallback)(long);
+  FlightSimInteger *_next;
+
+  static FlightSimInteger *_first;
+  static FlightSimInteger *_last;
+
+  friend int SimHost::setInt(const char *, long);
+};
+
+FlightSimInteger *FlightSimInteger::_first = 0;
+FlightSimInteger *FlightSimInteger::_last  = 0;
+
+
+//! Float dataref. Values are supplied with SimHost::setFloat().
+class FlightSimFloat {
+public:
+  FlightSimFloat() : _name(0), _value(0), _changeCallback(0), _next(0) {
+    if (_last)
+      _last->_next = this;
+    else
+      _first = this;
+    _last = this;
+  }
+
+  ~FlightSimFloat() {
+    FlightSimFloat **link = &_first;
+    FlightSimFloat *prev = 0;
+    while (*link && *link != this) {
+      prev = *link;
+      link = &(*link)->_next;
+    }
+    if (*link)
+      *link = _next;
+    if (_last == this)
+      _last = prev;
+  }
+
+  //! Subscribe. X-Plane sends the current value at once.
+  void assign(const _XpRefStr_ *s) {
+    _name = (const char *)s;
+    ++SimHost::datarefAssigns;
+    SimHost::DatarefValue *v = SimHost::datarefValue(_name, false);
+    if (v != 0)
+      _value = v->floatValue;
+  }
+  FlightSimFloat & operator = (const _XpRefStr_ *s) { assign(s); return *this; }
+
+  void write(float val) { _value = val; ++SimHost::datarefWrites; }
+  FlightSimFloat & operator = (float f) { write(f); return *this; }
+
+  float read(void) const { return _value; }
+  operator float () const { return _value; }
+
+  void onChange(void (*fptr)(float)) { _changeCallback = fptr; }
+
+private:
+  const char *_name;
+  float _value;
+  void (*_changeCallback)(float);
+  FlightSimFloat *_next;
+
+  static FlightSimFloat *_first;
+  static FlightSimFloat *_last;
+
+  friend int SimHost::setFloat(const char *, float);
+};
+
+FlightSimFloat *FlightSimFloat::_first = 0;
+FlightSimFloat *FlightSimFloat::_last  = 0;
+
+
+//! X-Plane command. Calls are counted in SimHost::commandBegins/Ends.
+class FlightSimCommand {
+public:
+  FlightSimCommand() : _name(0), _held(false) {}
+
+  void assign(const _XpRefStr_ *s) { _name = (const char *)s; }
+  FlightSimCommand & operator = (const _XpRefStr_ *s) { assign(s); return *this; }
+
+  void begin(void) { ++SimHost::commandBegins; _held = true; }
+  void end(void)   { ++SimHost::commandEnds; _held = false; }
+  void once(void)  { ++SimHost::commandBegins; ++SimHost::commandEnds; }
+
+  //! True between begin() and end()
+  bool held(void) const { return _held; }
+
+private:
+  const char *_name;
+  bool _held;
+};
+
+
+//! Deliver an integer value from "X-Plane". Returns number of subscribed
+//! datarefs set. Datarefs subscribed later get the value too.
+int SimHost::setInt(const char *ident, long value) {
+  DatarefValue *v = datarefValue(ident, true);
+  if (v != 0)
+    v->intValue = value;
+  int found = 0;
+  for (FlightSimInteger *dr = FlightSimInteger::_first; dr; dr = dr->_next) {
+    if (dr->_name && strcmp(dr->_name, ident) == 0) {
+      bool changed = (dr->_value != value);
+      dr->_value = value;
+      if (changed && dr->_changeCallback)
+        dr->_changeCallback(value);
+      ++found;
+    }
+  }
+  return found;
+}
+
+//! Deliver a float value from "X-Plane". Returns number of subscribed
+//! datarefs set. Datarefs subscribed later get the value too.
+int SimHost::setFloat(const char *ident, float value) {
+  DatarefValue *v = datarefValue(ident, true);
+  if (v != 0)
+    v->floatValue = value;
+  int found = 0;
+  for (FlightSimFloat *dr = FlightSimFloat::_first; dr; dr = dr->_next) {
+    if (dr->_name && strcmp(dr->_name, ident) == 0) {
+      bool changed = (dr->_value != value);
+      dr->_value = value;
+      if (changed && dr->_changeCallback)
+        dr->_changeCallback(value);
+      ++found;
+    }
+  }
+  return found;
+}
+
+//! Print every output pin and servo position, for regression diffs
+void SimHost::dumpState(FILE *out) {
+  for (int i = 0; i < SIMHOST_NUM_PINS; ++i) {
+    if (pinModes[i] == OUTPUT)
+      fprintf(out, "pin %d %s\n", i, pinOutputs[i] ? "HIGH" : "LOW");
+  }
+  for (int i = 0; i < SIMHOST_NUM_PINS; ++i) {
+    if (Servo::_attached[i])
+      fprintf(out, "servo %d %d\n", i, Servo::_angles[i]);
+  }
+}
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Entry point for running a sketch on the host
+
+#ifdef SIMOBJECTS_HOST_MAIN
+void setup(void);
+void loop(void);
+
+//! Runs setup() once and loop() argv[1] times (default 1000), then
+//! prints the final pin and servo state.
+int main(int argc, char **argv) {
+  unsigned long loops = 1000;
+  if (argc > 1)
+    loops = strtoul(argv[1], 0, 10);
+
+  setup();
+  for (unsigned long i = 0; i < loops; ++i)
+    loop();
+
+  SimHost::dumpState(stdout);
+  return 0;
+}
+#endif // SIMOBJECTS_HOST_MAIN
+
+#endif // SIMHALHOST_H
@@ -27,16 +27,65 @@
 #define SIMLEDDEV_H
 
 #include "SimObjectsDev.h"
+#include "SimOutputDev.h"
+#include "SimDataRefDev.h"
 
 // for code editing purposes
 // remove this from final version of SimLED
 //#include "usb_api.h"
 
+//! Shared flash timing for SimLEDs.
+/*! All rates are worked out from millis() once per SimObject::update()
+ *  pass, so every flashing SimLED is in phase with the others, and
+ *  faster rates change state together with slower ones.*/
+class SimFlash {
+public:
+  //! Flash rates. Normal is twice and Fast four times the Slow rate.
+  enum Rate {
+    Steady = 0,   //!< Not flashing
+    Slow   = 1,
+    Normal = 2,
+    Fast   = 4
+  };
+
+  //! Set the Slow flash period in milliseconds. Default 1000 (1 Hz).
+  static void setPeriod(unsigned int period) {
+    if (period >= 8)
+      _period = period;
+  }
+
+  //! Rates (Slow, Normal, Fast) in the lit half of their cycle at time
+  static unsigned char phase(unsigned long time) {
+    unsigned int t = time % _period;
+    unsigned int half = _period >> 1;
+    unsigned char lit = 0;
+    if (t < half)
+      lit |= Slow;
+    if (t % half < (half >> 1))
+      lit |= Normal;
+    if (t % (half >> 1) < (half >> 2))
+      lit |= Fast;
+    return lit;
+  }
+
+private:
+  static unsigned int _period;
+};
+
+unsigned int SimFlash::_period = 1000;
+
+
+
+
 //! High-level dataref-to-LED linking class
-/*! Incorporating bulb-test and power-available features.*/
+/*! Incorporating bulb-test, power-available and flashing features.
+ *  The LED pin is an Arduino pin number, or a SimOutput::pin() for LEDs
+ *  on other output devices. Pins are written once per
+ *  SimObject::update(), and only when they change.*/
 class SimLEDBase : public SimObject {
 public:
-  /// True if input conditions would cause this LED to light
+  /// True if input conditions would cause this LED to light. Dataref
+  /// LEDs without simulated power are never active.
   bool isActive(void) { return _active; }
 
   /// True if this LED should light, applying filters (power, test etc)
@@ -46,23 +95,109 @@ public:
   static void lightTest(bool lightAll)  {_testAll = lightAll;}
 
   /// Enable/disable this SimLED's participation in lightTests
-  void enableTest (bool allowTest)      {_allowTest = allowTest;}
+  void enableTest (bool allowTest) {
+    _allowTest = allowTest;
+    _dirty = true;
+  }
+
+  /// Flash at SimFlash::Normal rate while active, or stop flashing
+  void enableFlash (bool allowFlash) {
+    setFlashRate(allowFlash ? SimFlash::Normal : SimFlash::Steady);
+  }
+
+  /// Flash at the given rate while active. Bulb tests light steadily.
+  void setFlashRate (SimFlash::Rate rate) {
+    _filterMask = FilterTest | FilterEnabled | FilterPower
+                | (rate << FilterFlashShift);
+    _dirty = true;
+  }
 
 protected:
   SimLEDBase(const int  &ledPin,
              const bool &enableTest,
-             const bool *hasPowerFlag );
+             const bool *hasPowerFlag,
+             SimGroup   &group = _genericGroup );
 
   bool _active;
 
+  /// Apply bulb-test and power filters to _active, and drive the LED
+  void _updateLit(bool updateOutput);
+
+  /// Move the LED to another pin, before SimObject::setup()
+  void _setPin(const int &ledPin) {
+    _output = SimOutput::find(ledPin, _channel);
+  }
+
+  /// Set when the LED must be re-evaluated whether or not inputs changed
+  /*! Cleared once the LED's output has been written.*/
+  bool _dirty;
+
+  /// Set by listened-to SimLEDs when their state changes
+  bool _inputChanged;
+
+  /// Evaluate every pass and read inputs, as one tells another listener.
+  /// See _listenTo().
+  bool _pollInputs;
+
+  /// Have child tell this object (via _inputChanged) when it changes
+  /*! A SimLED can only tell one listener. A second listener instead
+   *  evaluates every pass. slot is passed back to _inputChangedAt().*/
+  void _listenTo(SimLEDBase *child, unsigned char slot = 0) {
+    if (child->_listener == 0) {
+      child->_listener = this;
+      child->_listenerSlot = slot;
+    } else if (child->_listener != this)
+      _pollInputs = true;
+  }
+
+  /// Tell our listener, if any, that our state has changed
+  void _notifyListener(void) {
+    if (_listener != 0) {
+      _listener->_inputChanged = true;
+      _listener->_inputChangedAt(_listenerSlot, _active);
+    }
+  }
+
+  /// Called when the child listened to as slot changes, with its
+  /// isActive() state, for listeners which track each input
+  virtual void _inputChangedAt(unsigned char /*slot*/, bool /*active*/) {}
+
+  /// Acknowledge and extinguish, for annunciator logic
+  virtual void _reset(void) {}
+
+  /// Start or end recall mode, for annunciator logic
+  virtual void _setRecall(bool /*mode*/) {}
+
+  friend class SimAnncNode;
+
+  /// True if _updateActive() must run this pass
+  bool _needsEvaluation(void) {
+    return !_incremental || _dirty || _inputChanged || _pollInputs;
+  }
+
 private:
-  /// Arduino pin number of LED.
-  int _pin;
+  /// Output driving the LED, or 0 if not connected
+  SimOutput *_output;
+
+  /// Channel of _output driving the LED
+  unsigned int _channel;
 
   bool _lit;
 
-  void _setup (void) { pinMode(_pin, OUTPUT); }
-  void _update(bool updateOutput = true);
+  /// Inputs given by _input() are SimLEDs, listened to from here, as
+  /// they may be constructed after this SimLED
+  void _setup (void) {
+    if (_output != 0)
+      _output->setupChannel(_channel);
+    SimObject *in;
+    for (unsigned char i = 0; (in = _input(i)) != 0; ++i)
+      _listenTo(static_cast<SimLEDBase*>(in), i);
+  }
+  void _update(bool updateOutput = true) {
+    _inputChanged = false;
+    _updateActive();
+    _updateLit(updateOutput);
+  }
 
   virtual void _updateActive() = 0;
 
@@ -70,6 +205,37 @@ private:
 
   static bool _testAll;
 
+  /// _active as of the last _updateLit()
+  bool _lastActive;
+
+  /// SimLED to tell when our state changes
+  SimLEDBase *_listener;
+
+  /// Which of _listener's inputs we are
+  unsigned char _listenerSlot;
+
+  /// Filter state (FilterTest etc) applied by the last _updateLit()
+  unsigned char _filters;
+
+  /// Filter bits which affect this LED
+  unsigned char _filterMask;
+
+  enum {
+    FilterTest    = 1,
+    FilterEnabled = 2,
+    FilterPower   = 4,
+    // then the SimFlash::phase() bits
+    FilterFlashShift = 3,
+    FilterFlash   = 7 << FilterFlashShift
+  };
+
+  /// Bulb-test, sim-enabled and flash state for this pass. Power is
+  /// this LED's own, and added by _updateLit().
+  static unsigned char _filterState(void);
+
+  static unsigned long _filterPass;
+  static unsigned char _filterCache;
+
 };
 
 
@@ -78,6 +244,8 @@ private:
 
 // Initialise static data members
 bool SimLEDBase::_testAll   = false;
+unsigned long SimLEDBase::_filterPass  = 0;
+unsigned char SimLEDBase::_filterCache = 0;
 
 
 
@@ -93,12 +261,50 @@ public:
               const bool   &enableTest   = true,
               const bool   *hasPowerFlag = &SimObject::hasPower );
 private:
-  FlightSimInteger _drInt;
+  /// Element of a SimLEDIntArrayDR, which calls _init()
+  SimLEDIntDR() : SimLEDBase(-1, true, &SimObject::hasPower, _typeGroup) {}
+  template <unsigned char N> friend class SimLEDIntArrayDR;
+
+  void _init(const char *ident, int lowLimit, int highLimit, bool invert);
+
+  FlightSimInteger *_drInt;
+
+  /// True once _drInt has been subscribed
+  bool _subscribed;
+
+  /// True while _active follows _drInt, i.e. while powered
+  bool _current;
+
   int _lowLimitInt;
   int _highLimitInt;
   bool _inverse;
 
-  void _updateActive();
+  /// Dataref value used by the last _updateActive()
+  int _lastInt;
+
+  /// Called directly by _updateDirect(), so not for overriding
+  void _updateActive() SIM_FINAL;
+
+  friend class SimObject;
+  static SimGroup _typeGroup;
+  void _updateDirect(bool updateOutput) {
+    // without power, the dataref is neither read nor asked for, and
+    // the LED counts as inactive so annunciators it feeds go out too
+    if (_powered()) {
+      if (!_subscribed) {
+        SimDataRefs::subscribe(*_drInt);
+        _subscribed = true;
+      }
+      if (!_current || *_drInt != _lastInt || _needsEvaluation()) {
+        SimLEDIntDR::_updateActive();
+        _current = true;
+      }
+    } else {
+      _active = false;
+      _current = false;
+    }
+    _updateLit(updateOutput);
+  }
 };
 
 
@@ -114,12 +320,50 @@ public:
                 const bool   *hasPowerFlag = &SimObject::hasPower );
 
 private:
-  FlightSimFloat _drFloat;
+  /// Element of a SimLEDFloatArrayDR, which calls _init()
+  SimLEDFloatDR() : SimLEDBase(-1, true, &SimObject::hasPower, _typeGroup) {}
+  template <unsigned char N> friend class SimLEDFloatArrayDR;
+
+  void _init(const char *ident, float lowLimit, float highLimit, bool invert);
+
+  FlightSimFloat *_drFloat;
+
+  /// True once _drFloat has been subscribed
+  bool _subscribed;
+
+  /// True while _active follows _drFloat, i.e. while powered
+  bool _current;
+
   double _lowLimitFloat;
   double _highLimitFloat;
   bool _inverse;
 
-  void _updateActive();
+  /// Dataref value used by the last _updateActive()
+  float _lastFloat;
+
+  /// Called directly by _updateDirect(), so not for overriding
+  void _updateActive() SIM_FINAL;
+
+  friend class SimObject;
+  static SimGroup _typeGroup;
+  void _updateDirect(bool updateOutput) {
+    // without power, the dataref is neither read nor asked for, and
+    // the LED counts as inactive so annunciators it feeds go out too
+    if (_powered()) {
+      if (!_subscribed) {
+        SimDataRefs::subscribe(*_drFloat);
+        _subscribed = true;
+      }
+      if (!_current || *_drFloat != _lastFloat || _needsEvaluation()) {
+        SimLEDFloatDR::_updateActive();
+        _current = true;
+      }
+    } else {
+      _active = false;
+      _current = false;
+    }
+    _updateLit(updateOutput);
+  }
 };
 
 
@@ -129,49 +373,172 @@ public:
   SimLEDLocal(const int  &ledPin,
               const bool &enableTest = true,
               const bool *hasPowerFlag = &SimObject::hasPower)
-    : SimLEDBase(ledPin, enableTest, hasPowerFlag)
+    : SimLEDBase(ledPin, enableTest, hasPowerFlag, _typeGroup)
   { _active = false; }
 
   void setActive(bool active) { _active = active; }
 
 private:
   void _updateActive() {}
+
+  friend class SimObject;
+  static SimGroup _typeGroup;
+  void _updateDirect(bool updateOutput) { _updateLit(updateOutput); }
+};
+
+
+
+//! N SimLEDIntDRs on the elements of one array dataref.
+/*! Element i drives ledPins[i]. All elements share the limits and
+ *  options, and are declared with one SIM_DATAREF_ARRAY identifier.
+ *  Each element is an ordinary SimLEDIntDR, so it can feed annunciators.
+ *  \code
+ *  SIM_DATAREF_ARRAY(genOffIdent, ANNC "generator_off", 2);
+ *  const int genOffPins[2] = { 5, 6 };
+ *  SimLEDIntArrayDR<2> genOff(genOffPins, genOffIdent);
+ *  SimLEDBase * const elecAnncs[] = { &genOff[0], &genOff[1] };
+ *  \endcode
+ */
+template <unsigned char N>
+class SimLEDIntArrayDR {
+public:
+  //! \param ledPins LED pin for each element, or -1
+  //! \param idents Element identifiers, from SIM_DATAREF_ARRAY
+  //! Other parameters are as for SimLEDIntDR.
+  template <size_t W>
+  SimLEDIntArrayDR(const int    (&ledPins)[N],
+                   const char   (&idents)[N][W],
+                   const int    &lowLimit     = 1,
+                   const int    &highLimit    = 32000,
+                   const bool   &invertLimits = false,
+                   const bool   &enableTest   = true,
+                   const bool   *hasPowerFlag = &SimObject::hasPower )
+  {
+    for (unsigned char i = 0; i < N; ++i) {
+      _leds[i]._setPin(ledPins[i]);
+      _leds[i].enableTest(enableTest);
+      _leds[i].setPowerSource(hasPowerFlag);
+      _leds[i]._init(idents[i], lowLimit, highLimit, invertLimits);
+    }
+  }
+
+  SimLEDIntDR &operator[](unsigned char i) { return _leds[i]; }
+
+private:
+  SimLEDIntDR _leds[N];
+};
+
+
+
+//! N SimLEDFloatDRs on the elements of one array dataref.
+/*! As SimLEDIntArrayDR, with the parameters of SimLEDFloatDR.*/
+template <unsigned char N>
+class SimLEDFloatArrayDR {
+public:
+  template <size_t W>
+  SimLEDFloatArrayDR(const int    (&ledPins)[N],
+                     const char   (&idents)[N][W],
+                     const float  &lowLimit,
+                     const float  &highLimit,
+                     const bool   &invertLimits = false,
+                     const bool   &enableTest   = true,
+                     const bool   *hasPowerFlag = &SimObject::hasPower )
+  {
+    for (unsigned char i = 0; i < N; ++i) {
+      _leds[i]._setPin(ledPins[i]);
+      _leds[i].enableTest(enableTest);
+      _leds[i].setPowerSource(hasPowerFlag);
+      _leds[i]._init(idents[i], lowLimit, highLimit, invertLimits);
+    }
+  }
+
+  SimLEDFloatDR &operator[](unsigned char i) { return _leds[i]; }
+
+private:
+  SimLEDFloatDR _leds[N];
 };
 
 
+SimGroup SimLEDIntDR::_typeGroup   = SIM_GROUP(SimLEDIntDR, SimObject::LevelInput);
+SimGroup SimLEDFloatDR::_typeGroup = SIM_GROUP(SimLEDFloatDR, SimObject::LevelInput);
+SimGroup SimLEDLocal::_typeGroup   = SIM_GROUP(SimLEDLocal, SimObject::LevelInput);
+
+
 
 
 SimLEDBase::SimLEDBase(const int  &ledPin,
                        const bool &enableTest,
-                       const bool *hasPowerFlag
+                       const bool *hasPowerFlag,
+                       SimGroup   &group
                        ) :
   SimObject(hasPowerFlag),
-  _pin(ledPin),
-  _allowTest(enableTest)
+  _active(false),
+  _dirty(true),
+  _inputChanged(false),
+  _pollInputs(false),
+  _output(SimOutput::find(ledPin, _channel)),
+  _lit(false),
+  _allowTest(enableTest),
+  _lastActive(false),
+  _listener(0),
+  _listenerSlot(0),
+  _filters(0),
+  _filterMask(FilterTest | FilterEnabled | FilterPower)
 {
-  _addToLinkedList();
+  _addToGroup(group);
+}
+
+
+unsigned char SimLEDBase::_filterState(void) {
+  // worked out by the first SimLED to ask in each pass
+  if (_filterPass != _passCount) {
+    _filterPass = _passCount;
+    _filterCache = (_testAll ? FilterTest : 0)
+                 | (SimHAL::simEnabled() ? FilterEnabled : 0)
+                 | (SimFlash::phase(SimHAL::millisNow()) << FilterFlashShift);
+  }
+  return _filterCache;
 }
 
 
 // Determine whether this SimLED should be lit
-void SimLEDBase::_update(bool updateOutput) {
+void SimLEDBase::_updateLit(bool updateOutput) {
 
-  _updateActive();
+  bool changed = (_active != _lastActive);
+  if (changed) {
+    _lastActive = _active;
+    _notifyListener();
+  }
+
+  // in incremental mode, nothing to do unless something has changed.
+  // Filters are compared per LED, as an LED may not be updated every pass
+  unsigned char filters = (_filterState() | (_powered() ? FilterPower : 0))
+                         & _filterMask;
+  if (_incremental && !changed && !_dirty && filters == _filters)
+    return;
+  _filters = filters;
 
   _lit = _active;
 
+  // flashing lights are out in the dark half of their flash cycle
+  if ((_filterMask & FilterFlash) && !(filters & FilterFlash))
+    _lit = false;
+
   // we are lit if bulb-test is active
-  if( (_allowTest == true) && (_testAll == true) )
+  if( (_allowTest == true) && (filters & FilterTest) )
     _lit = true;
 
   // we are not lit if the sim isn't running or no simulated power
-  if( (FlightSim.isEnabled() == false) || (hasPower == false) ) {
+  if( (filters & (FilterEnabled | FilterPower))
+      != (FilterEnabled | FilterPower) ) {
     _lit = false;
   }
 
   // unless ordered otherwise, light or extinguish LED based on our lighting state
-  if (updateOutput)
-    digitalWrite(_pin, _lit);
+  // if not written now, make sure we are written next time
+  if (updateOutput && _output != 0)
+    _output->write(_channel, _lit);
+  _dirty = !updateOutput;
 }
 
 
@@ -185,10 +552,16 @@ SimLEDIntDR::SimLEDIntDR(
     const bool   &invertLimits,
     const bool   &enableTest,
     const bool   *hasPowerFlag
-    ) : SimLEDBase(ledPin, enableTest, hasPowerFlag)
+    ) : SimLEDBase(ledPin, enableTest, hasPowerFlag, _typeGroup)
 {
-  _drInt.assign((const _XpRefStr_ *) ident);
+  _init(ident, lowLimit, highLimit, invertLimits);
+} // constructor
 
+void SimLEDIntDR::_init(const char *ident,
+                        int lowLimit, int highLimit, bool invert) {
+  _drInt = &SimDataRefs::intRef(ident);
+  _subscribed = false;
+  _current = false;
   if (lowLimit < highLimit) {
     _lowLimitInt = lowLimit;
     _highLimitInt = highLimit;
@@ -196,12 +569,13 @@ SimLEDIntDR::SimLEDIntDR(
     _lowLimitInt = highLimit;
     _highLimitInt = lowLimit;
   }
-  _inverse = invertLimits;
-
-} // constructor
+  _inverse = invert;
+  _lastInt = 0;
+}
 
-void SimLEDIntDR::_updateActive() {
-  _active = (_lowLimitInt <= _drInt && _drInt <= _highLimitInt);
+inline void SimLEDIntDR::_updateActive() {
+  _lastInt = *_drInt;
+  _active = (_lowLimitInt <= _lastInt && _lastInt <= _highLimitInt);
   if (_inverse == true) {
     _active = _active? false: true;
   }
@@ -217,10 +591,17 @@ SimLEDFloatDR::SimLEDFloatDR(const int    &ledPin,
                              const bool   &invertLimits,
                              const bool   &enableTest,
                              const bool   *hasPowerFlag
-                             ) : SimLEDBase(ledPin, enableTest, hasPowerFlag)
+                             ) : SimLEDBase(ledPin, enableTest, hasPowerFlag,
+                                            _typeGroup)
 {
-  _drFloat.assign((const _XpRefStr_ *) ident);
+  _init(ident, lowLimit, highLimit, invertLimits);
+} // constructor
 
+void SimLEDFloatDR::_init(const char *ident,
+                          float lowLimit, float highLimit, bool invert) {
+  _drFloat = &SimDataRefs::floatRef(ident);
+  _subscribed = false;
+  _current = false;
   if (lowLimit < highLimit) {
     _lowLimitFloat = lowLimit;
     _highLimitFloat = highLimit;
@@ -229,13 +610,15 @@ SimLEDFloatDR::SimLEDFloatDR(const int    &ledPin,
     _highLimitFloat = lowLimit;
   }
 
-  _inverse = invertLimits;
-} // constructor
+  _inverse = invert;
+  _lastFloat = 0;
+}
 
 
-void SimLEDFloatDR::_updateActive() {
-  _active = (   _lowLimitFloat <= _drFloat
-                && _drFloat <= _highLimitFloat);
+inline void SimLEDFloatDR::_updateActive() {
+  _lastFloat = *_drFloat;
+  _active = (   _lowLimitFloat <= _lastFloat
+                && _lastFloat <= _highLimitFloat);
   if (_inverse == true) {
     _active = _active? false: true;
   }
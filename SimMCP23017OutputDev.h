@@ -0,0 +1,143 @@
+
+// SimMCP23017Output Development Version
+
+/*
+     * Copyright 2012 Jack Deeth
+     * Contact: simulationelectronics@gmail.com
+     *
+     * SimOutput for MCP23017 16-bit I2C port expanders, giving 16 LED
+     * outputs per chip and up to 8 chips on the two I2C pins.
+     * The sketch must also #include <Wire.h>.
+     *
+     * This program is free software: you can redistribute it and/or modify
+     * it under the terms of the GNU Lesser General Public License as
+     * published by the Free Software Foundation, either version 3 of the
+     * License, or (at your option) any later version.
+     *
+     * This program is distributed in the hope that it will be useful,
+     * but WITHOUT ANY WARRANTY; without even the implied warranty of
+     * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+     * GNU Lesser General Public License for more details.
+     *
+     * You should have received a copy of the GNU Lesser General Public
+     * License along with this program.
+     * If not, see <http://www.gnu.org/licenses/>.
+     *
+     * I would appreciate, but not insist, on attribution if this code is
+     * incorporated into other projects.
+     */
+
+#ifndef SIMMCP23017OUTPUTDEV_H
+#define SIMMCP23017OUTPUTDEV_H
+
+#include <Wire.h>
+#include "SimOutputDev.h"
+
+namespace SimHAL {
+
+//! Start the I2C bus as master
+inline void i2cBegin(void) { Wire.begin(); }
+
+//! Write count bytes to device address in one transmission.
+/*! Returns true if the device acknowledged.*/
+inline bool i2cWrite(unsigned char address,
+                     const unsigned char *data, unsigned char count) {
+  Wire.beginTransmission(address);
+  for (unsigned char i = 0; i < count; ++i)
+    Wire.write(data[i]);
+  return Wire.endTransmission() == 0;
+}
+
+} // namespace SimHAL
+
+
+
+//! LEDs on an MCP23017 I2C port expander.
+/*! Channels 0-7 are GPA0-7 and 8-15 are GPB0-7. Only pins used by a
+ *  SimLED are made outputs. Both output latches are sent in one I2C
+ *  transmission, and only in passes where an LED on the chip changed.
+ *  \code
+ *  SimMCP23017Output aftOverhead(0);       // A2..A0 tied low
+ *  SimLEDIntDR bleedTrip(aftOverhead.pin(12), bleedTripIdent);
+ *  \endcode
+ */
+class SimMCP23017Output : public SimOutput {
+public:
+  //! \param address 0-7, as set on the chip's A2..A0 pins
+  SimMCP23017Output(unsigned char address) :
+    _address(0x20 | (address & 7)),
+    _outputs(0),
+    _frame(0),
+    _changed(true),
+    _configured(false)
+  {}
+
+  bool channel(unsigned int n, unsigned int &handle) {
+    handle = n;
+    return n < 16;
+  }
+
+  void setupChannel(unsigned int handle) { _outputs |= 1U << handle; }
+
+  void write(unsigned int handle, bool state) {
+    unsigned int bits = state ? _frame | (1U << handle)
+                              : _frame & ~(1U << handle);
+    if (bits != _frame) {
+      _frame = bits;
+      _changed = true;
+    }
+  }
+
+private:
+  //! MCP23017 registers, with IOCON.BANK = 0 (power-on default)
+  enum {
+    _IODIRA = 0x00,
+    _OLATA  = 0x14
+  };
+
+  unsigned char _address;
+
+  //! Channels set up as outputs, one bit each
+  unsigned int _outputs;
+
+  //! Output latch contents, GPA in the low byte
+  unsigned int _frame;
+
+  //! True if _frame differs from what the chip holds
+  bool _changed;
+
+  //! True once the chip has acknowledged its pin directions
+  bool _configured;
+
+  // Called after the SimLEDs' setup, so _outputs is complete
+  void _setup(void) {
+    SimHAL::i2cBegin();
+    _configured = false;
+    _changed = true;
+    _flush();
+  }
+
+  void _flush(void) {
+    if (!_changed)
+      return;
+    // a chip which was missing, or dropped out and may have reset to
+    // all inputs, is given its pin directions again first
+    if (!_configured) {
+      unsigned char iodir[3] = { _IODIRA,
+                                 (unsigned char)~_outputs,
+                                 (unsigned char)(~_outputs >> 8) };
+      _configured = SimHAL::i2cWrite(_address, iodir, 3);
+      if (!_configured)
+        return;
+    }
+    unsigned char olat[3] = { _OLATA,
+                              (unsigned char)_frame,
+                              (unsigned char)(_frame >> 8) };
+    // try again next pass if the chip didn't answer
+    _changed = !SimHAL::i2cWrite(_address, olat, 3);
+    _configured = !_changed;
+  }
+};
+
+
+#endif // SIMMCP23017OUTPUTDEV_H
@@ -0,0 +1,254 @@
+
+// SimMatrixOutput Development Version
+
+/*
+     * Copyright 2012 Jack Deeth
+     * Contact: simulationelectronics@gmail.com
+     *
+     * SimOutput for a multiplexed row/column LED matrix, scanned from a
+     * timer interrupt so the refresh is steady however long
+     * SimObject::update() takes.
+     *
+     * This program is free software: you can redistribute it and/or modify
+     * it under the terms of the GNU Lesser General Public License as
+     * published by the Free Software Foundation, either version 3 of the
+     * License, or (at your option) any later version.
+     *
+     * This program is distributed in the hope that it will be useful,
+     * but WITHOUT ANY WARRANTY; without even the implied warranty of
+     * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+     * GNU Lesser General Public License for more details.
+     *
+     * You should have received a copy of the GNU Lesser General Public
+     * License along with this program.
+     * If not, see <http://www.gnu.org/licenses/>.
+     *
+     * I would appreciate, but not insist, on attribution if this code is
+     * incorporated into other projects.
+     */
+
+#ifndef SIMMATRIXOUTPUTDEV_H
+#define SIMMATRIXOUTPUTDEV_H
+
+// the scan needs the SimHAL timer, which has to be asked for before
+// SimTimerDev.h is first included
+#if !defined(SIM_USE_TIMER) && !defined(SIMTIMERDEV_H)
+#define SIM_USE_TIMER
+#endif
+#if !defined(SIM_USE_TIMER)
+#error "SimMatrixOutput needs the timer: #define SIM_USE_TIMER before including any SimObjects header"
+#endif
+
+#include "SimOutputDev.h"
+#include "SimTimerDev.h"
+
+//! Most rows a SimMatrixOutput can scan
+#ifndef SIM_MATRIX_MAX_ROWS
+#define SIM_MATRIX_MAX_ROWS 8
+#endif
+
+//! Most columns a SimMatrixOutput can drive
+#define SIM_MATRIX_MAX_COLS 16
+
+
+//! LEDs in a row/column matrix, scanned one row at a time by interrupt.
+/*! Each LED sits where a row pin and a column pin cross. The timer
+ *  interrupt lights one row at a time, so with R rows each LED is lit
+ *  for 1/R of the time: choose resistors and driver transistors to
+ *  suit. Channel n is row n / columns, column n % columns.
+ *
+ *  SimLEDs write into a back buffer during SimObject::update(). If it
+ *  changed, the buffers are swapped at the end of the pass, so the
+ *  interrupt only ever shows complete frames. The scan takes the same
+ *  time every tick, whatever the loop is doing.
+ *
+ *  Only one SimMatrixOutput can be scanned, as it takes the board's
+ *  SimHAL timer (see SimTimerDev.h); check scanning() after
+ *  SimObject::setup(). SimOutput::setCommitRate() shares the timer
+ *  with it; the matrix still swaps its frames at the end of each pass.
+ *  \code
+ *  const int rows[4] = { 2, 3, 4, 5 };
+ *  const int cols[8] = { 14, 15, 16, 17, 18, 19, 20, 21 };
+ *  SimMatrixOutput overhead(rows, cols);   // 32 LEDs on 12 pins
+ *  SimLEDIntDR packOff(overhead.pin(9), packOffIdent);
+ *  \endcode
+ */
+class SimMatrixOutput : public SimOutput {
+public:
+  //! \param rowPins Arduino pins driving each row
+  //! \param colPins Arduino pins driving each column
+  //! \param refreshRate Complete scans of the matrix per second, at
+  //!        least 1
+  //! \param rowActive Level which selects a row (HIGH for rows driving
+  //!        LED anodes, LOW for cathodes or inverting drivers)
+  //! \param colActive Level which lights a column's LED in the
+  //!        selected row
+  template <size_t R, size_t C>
+  SimMatrixOutput(const int (&rowPins)[R],
+                  const int (&colPins)[C],
+                  unsigned int refreshRate = 100,
+                  bool rowActive = true,
+                  bool colActive = false) :
+    _rowPins(rowPins),
+    _colPins(colPins),
+    _rows(R),
+    _cols(C),
+    _refreshRate(refreshRate ? refreshRate : 1),
+    _rowActive(rowActive),
+    _colActive(colActive),
+    _front(0),
+    _scanRow(0),
+    _changed(false),
+    _scanning(false)
+  {
+    SIM_STATIC_ASSERT(R >= 1 && R <= SIM_MATRIX_MAX_ROWS,
+                      SimMatrixOutput_rows_out_of_range);
+    SIM_STATIC_ASSERT(C >= 1 && C <= SIM_MATRIX_MAX_COLS,
+                      SimMatrixOutput_columns_out_of_range);
+    for (int b = 0; b < 2; ++b)
+      for (int r = 0; r < SIM_MATRIX_MAX_ROWS; ++r)
+        _frame[b][r] = 0;
+  }
+
+  ~SimMatrixOutput() {
+    if (_scanned == this) {
+      _setScan(0, 0);
+      _scanned = 0;
+    }
+  }
+
+  bool channel(unsigned int n, unsigned int &handle) {
+    if (n >= (unsigned int)_rows * _cols)
+      return false;
+    handle = ((n / _cols) << 4) | (n % _cols);
+    return true;
+  }
+
+  //! True if the timer interrupt is scanning the matrix. If not, as on
+  //! a board without a SimHAL timer, each update lights the next row
+  //! instead, which flickers unless loop() is very quick.
+  bool scanning(void) const { return _scanning; }
+
+  void write(unsigned int handle, bool state) {
+    unsigned int &row = _frame[_front ^ 1][handle >> 4];
+    unsigned int bits = state ? row | (1U << (handle & 15))
+                              : row & ~(1U << (handle & 15));
+    if (bits != row) {
+      row = bits;
+      _changed = true;
+    }
+  }
+
+private:
+  const int *_rowPins;
+  const int *_colPins;
+  unsigned char _rows;
+  unsigned char _cols;
+  unsigned int _refreshRate;
+  bool _rowActive;
+  bool _colActive;
+
+  //! Column bitmaps per row. The interrupt shows _frame[_front].
+  unsigned int _frame[2][SIM_MATRIX_MAX_ROWS];
+  volatile unsigned char _front;
+
+  //! Row lit by the interrupt
+  unsigned char _scanRow;
+
+  //! True if the back buffer differs from the front
+  bool _changed;
+
+  //! See scanning()
+  bool _scanning;
+
+  //! Port and mask of each pin, so the interrupt needs no lookups
+  unsigned char _rowPort[SIM_MATRIX_MAX_ROWS];
+  unsigned char _rowMask[SIM_MATRIX_MAX_ROWS];
+  unsigned char _colPort[SIM_MATRIX_MAX_COLS];
+  unsigned char _colMask[SIM_MATRIX_MAX_COLS];
+
+  //! The matrix being scanned by the timer
+  static SimMatrixOutput *_scanned;
+
+  static void _isr(void) { _scanned->_scan(); }
+
+  //! Light the next row. Called from the timer interrupt. Pins which
+  //! are not connected have a mask of 0, and no port to write.
+  void _scan(void) {
+    unsigned char on  = _colActive ? 0xFF : 0;
+    unsigned char off = ~on;
+
+    // turn off the old row before changing columns, to avoid ghosting
+    if (_rowMask[_scanRow])
+      SimHAL::writePortBits(_rowPort[_scanRow], _rowMask[_scanRow],
+                            _rowActive ? 0 : 0xFF);
+
+    if (++_scanRow >= _rows)
+      _scanRow = 0;
+
+    unsigned int bits = _frame[_front][_scanRow];
+    for (unsigned char c = 0; c < _cols; ++c, bits >>= 1) {
+      if (_colMask[c])
+        SimHAL::writePortBits(_colPort[c], _colMask[c],
+                              (bits & 1) ? on : off);
+    }
+
+    if (_rowMask[_scanRow])
+      SimHAL::writePortBits(_rowPort[_scanRow], _rowMask[_scanRow],
+                            _rowActive ? 0xFF : 0);
+  }
+
+  void _setup(void);
+
+  void _flush(void) {
+    if (_changed) {
+      // show the new frame, and carry it on as the base of the next one
+      _front ^= 1;
+      for (unsigned char r = 0; r < _rows; ++r)
+        _frame[_front ^ 1][r] = _frame[_front][r];
+      _changed = false;
+    }
+    if (!_scanning)
+      _scan();
+  }
+};
+
+
+SimMatrixOutput *SimMatrixOutput::_scanned = 0;
+
+
+void SimMatrixOutput::_setup(void) {
+  for (unsigned char r = 0; r < _rows; ++r) {
+    if (!SimHAL::pinPort(_rowPins[r], _rowPort[r], _rowMask[r])) {
+      _rowPort[r] = _rowMask[r] = 0;
+      continue;
+    }
+    SimHAL::outputPortBits(_rowPort[r], _rowMask[r]);
+    SimHAL::writePortBits(_rowPort[r], _rowMask[r], _rowActive ? 0 : 0xFF);
+  }
+  for (unsigned char c = 0; c < _cols; ++c) {
+    if (!SimHAL::pinPort(_colPins[c], _colPort[c], _colMask[c])) {
+      _colPort[c] = _colMask[c] = 0;
+      continue;
+    }
+    SimHAL::outputPortBits(_colPort[c], _colMask[c]);
+    SimHAL::writePortBits(_colPort[c], _colMask[c], _colActive ? 0 : 0xFF);
+  }
+
+  // the first frame is shown as soon as the scan starts
+  _scanning = true;
+  _flush();
+
+  _scanRow = 0;
+  _scanned = this;
+  unsigned long period = 1000000UL / ((unsigned long)_refreshRate * _rows);
+  _scanning = _setScan(&SimMatrixOutput::_isr, period ? period : 1);
+  if (!_scanning) {
+    // no timer, or none at this rate: rows are lit from _flush()
+    _setScan(0, 0);
+    _scanned = 0;
+  }
+}
+
+
+#endif // SIMMATRIXOUTPUTDEV_H
@@ -1,19 +1,72 @@
 #ifndef SIMOBJECTSDEV_H
 #define SIMOBJECTSDEV_H
 
-#include "SimObjectsDev.h"
+#include "SimHALDev.h"
 
-#if defined(ARDUINO) && ARDUINO >= 100
-#include "Arduino.h"
-#elif defined(WIRING)
-#include "Wiring.h"
+//! Aid for recording the dataref identifier
+#define DataRefIdent PROGMEM const char
+
+//! Compile-time check, for C++98 compilers without static_assert.
+/*! Fails to compile with an error naming msg if cond is false. msg must
+ *  be a valid identifier, e.g. SIM_STATIC_ASSERT(N > 1, map_too_short).*/
+#if defined(__GNUC__)
+#define SIM_STATIC_ASSERT(cond, msg) \
+  typedef char SimStaticAssert_##msg[(cond) ? 1 : -1] __attribute__((unused))
 #else
-#include "WProgram.h"
-#include "pins_arduino.h"
+#define SIM_STATIC_ASSERT(cond, msg) \
+  typedef char SimStaticAssert_##msg[(cond) ? 1 : -1]
 #endif
 
-//! Aid for recording the dataref identifier
-#define DataRefIdent PROGMEM const char
+//! Marks an override which its class's _updateDirect() calls directly,
+//! so a further override in a subclass would never run. Checked by C++11
+//! and later compilers; a note to the reader before then.
+#if __cplusplus >= 201103L
+#define SIM_FINAL final
+#else
+#define SIM_FINAL
+#endif
+
+//! A set of N flags packed into 32-bit words.
+/*! Whole-set tests and updates work a word at a time rather than a
+ *  flag at a time.*/
+template <unsigned int N>
+class SimBits {
+public:
+  SimBits() { clear(); }
+
+  void clear(void) {
+    for (unsigned char i = 0; i < _Words; ++i)
+      _w[i] = 0;
+  }
+
+  void set(unsigned int n) { _w[n >> 5] |= (uint32_t)1 << (n & 31); }
+
+  void reset(unsigned int n) { _w[n >> 5] &= ~((uint32_t)1 << (n & 31)); }
+
+  bool test(unsigned int n) const {
+    return (_w[n >> 5] >> (n & 31)) & 1;
+  }
+
+  //! True if any flag is set
+  bool any(void) const {
+    uint32_t bits = 0;
+    for (unsigned char i = 0; i < _Words; ++i)
+      bits |= _w[i];
+    return bits != 0;
+  }
+
+  //! True if any flag set here is clear in other
+  bool anyNotIn(const SimBits &other) const {
+    uint32_t bits = 0;
+    for (unsigned char i = 0; i < _Words; ++i)
+      bits |= _w[i] & ~other._w[i];
+    return bits != 0;
+  }
+
+private:
+  enum { _Words = (N + 31) / 32 };
+  uint32_t _w[_Words];
+};
 
 // Comments for parsing by Doxygen:
 
@@ -49,11 +102,90 @@
 
 
 
+class SimObject;
+
+#ifdef SIMOBJECTS_PROFILE
+//! Update cost counters, kept when built with SIMOBJECTS_PROFILE.
+/*! Times are in SIMHAL_PROFILE_UNIT: CPU cycles where the board counts
+ *  them, otherwise microseconds.*/
+struct SimProfile {
+  unsigned long calls;  //!< Updates timed
+  unsigned long total;  //!< Time spent in them
+  unsigned long max;    //!< Longest of them
+
+  void add(unsigned long time) {
+    ++calls;
+    total += time;
+    if (time > max)
+      max = time;
+  }
+};
+#endif
+
+//! A list of SimObjects of one concrete type, updated together.
+/*! Each class with its own group supplies an update function which
+ *  walks the members calling them directly, rather than through the
+ *  virtual _update(). Groups are updated in increasing order of level,
+ *  so objects reading datarefs are updated before the logic that
+ *  depends on them, except that SimObject::setup() moves a group after
+ *  any later group it reads from. Within a group, setup() puts each
+ *  member after the members it reads.
+ *
+ *  Groups are declared as static class members and aggregate
+ *  initialised with SIM_GROUP(), so they are ready before any SimObject
+ *  is constructed:
+ *  \code
+ *  SimGroup MyClass::_typeGroup = SIM_GROUP(MyClass, SimObject::LevelLogic);
+ *  \endcode
+ */
+struct SimGroup {
+  //! Updates every member of the group
+  void (*update)(SimGroup &group, bool updateOutput);
+
+  //! Groups with a lower level are updated first
+  unsigned char level;
+
+  //! First member, or 0 if empty
+  SimObject *first;
+
+  //! Last member, or 0 if empty
+  SimObject *last;
+
+  //! Next group in update order
+  SimGroup *next;
+
+#ifdef SIMOBJECTS_PROFILE
+  //! Class name, for SimObject::profileReport()
+  const char *name;
+
+  //! Totals over every member
+  SimProfile profile;
+#endif
+};
+
+#ifdef SIMOBJECTS_PROFILE
+#define SIM_GROUP_PROFILE_INIT(name) , name, { 0, 0, 0 }
+#else
+#define SIM_GROUP_PROFILE_INIT(name)
+#endif
+
+//! Initialiser for a SimGroup with its own update function
+#define SIM_GROUP_INIT(update, level, name) \
+  { update, level, 0, 0, 0 SIM_GROUP_PROFILE_INIT(name) }
+
+//! Initialiser for the SimGroup of class T, see SimObject::_updateGroup()
+#define SIM_GROUP(T, level) \
+  SIM_GROUP_INIT(&SimObject::_updateGroup<T>, level, #T)
+
+
+
 class SimObject {
 public:
   //! \param powerSource Pointer to bool which defines whether simulated
-  //!        power is available to this SimObject
+  //!        power is available to this SimObject. Detaches the object
+  //!        from any SimPowerBus.
   void setPowerSource (const bool * powerSource) {
+    _detachFromBus();
     _powerSource = powerSource;
 
     if (powerSource == 0)
@@ -63,21 +195,151 @@ public:
   }
 
 
+  //! Put every object after the objects it reads, then set them up
   static void setup(void);
+
+  //! Update every object, in three phases.
+  /*! Sample: switch banks read the panel and SimPowerBuses settle this
+   *  pass's power (LevelSwitch and LevelPower).
+   *  Evaluate: inputs and logic, each object after its inputs, so a
+   *  change reaches the top of an annunciator tree in the same pass
+   *  whatever the declaration order. Commit: SimOutputs send the
+   *  frames the others wrote, together (LevelOutput).*/
   static void update (bool updateOutput = true);
 
+  //! Number of inputs read before they are updated in each pass.
+  /*! Only a loop of objects reading each other leaves some reading the
+   *  previous pass's state. 0 for any panel without such a loop.
+   *  Worked out by setup().*/
+  static unsigned int lagging(void) { return _lagging; }
+
   //! Default simulated power source
   static bool hasPower;
 
+  //! Only re-evaluate objects whose inputs have changed.
+  /*! In incremental mode, dataref-fed objects compare their dataref with
+   *  the value they last used and skip their logic and output if
+   *  nothing changed, and logic objects such as b737::SystemAnnc only
+   *  re-evaluate when one of their inputs changed state. Outputs are
+   *  the same as when every object is evaluated every pass (the default).
+   */
+  static void setIncremental(bool incremental) { _incremental = incremental; }
+
+  //! How an object is treated when update() has a time budget
+  enum Priority {
+    PriorityNormal,   //!< Updated in turn with others when time is short
+    PriorityCritical  //!< Updated every pass, whatever the budget
+  };
+
+  //! Set this object's priority. Default is PriorityNormal.
+  void setPriority(Priority priority) {
+    _critical = (priority == PriorityCritical);
+  }
+
+  //! Update this object at most once every interval milliseconds.
+  /*! 0 (the default) updates it on every pass. Intervals of up to about
+   *  30 seconds are supported.*/
+  void setInterval(unsigned int interval) { _interval = interval; }
+
+  //! Limit the time each update() spends on PriorityNormal objects.
+  /*! Once budget microseconds have passed since the start of update(),
+   *  remaining PriorityNormal objects wait for a later pass, and the
+   *  objects which waited are updated first next time, so everything
+   *  is updated in turn. PriorityCritical objects are always updated.
+   *  0 (the default) means no limit.*/
+  static void setBudget(unsigned long budget) { _budget = budget; }
+
+#ifdef SIMOBJECTS_PROFILE
+  //! Print update() pass times and the cost of each class and object.
+  /*! Only available when built with SIMOBJECTS_PROFILE, e.g.
+   *  SimObject::profileReport(Serial).*/
+  static void profileReport(Print &out);
+
+  //! Clear all profiling counters
+  static void profileReset(void);
+
+  //! This object's update costs
+  const SimProfile &profile(void) const { return _profile; }
+#endif
+
+  //! Removes this object from the update list.
+  /*! Safe to call from within SimObject::update(), including from the
+   *  object's own _update(). Note that Teensyduino keeps its own list of
+   *  FlightSimInteger/FlightSimFloat objects and does not remove them
+   *  when they are destroyed, so objects owning a dataref should not be
+   *  deleted on the Teensy itself.
+   */
+  virtual ~SimObject() {
+    _detachFromBus();
+    _removeFromLinkedList();
+  }
+
+  //! Update order of SimGroups. Gaps leave room for new groups.
+  enum GroupLevel {
+    LevelSwitch  = 2,   //!< Hardware inputs, read before anything else
+    LevelPower   = 5,   //!< SimPowerBuses, so others see this pass's power
+    LevelInput   = 10,  //!< Objects driven directly by datarefs
+    LevelGeneric = 20,  //!< Objects without a group of their own
+    LevelLogic   = 30,  //!< Objects combining other objects' states
+    LevelMaster  = 40,  //!< Objects combining LevelLogic objects
+    LevelOutput  = 50   //!< Output devices sending what the rest wrote
+  };
+
 protected:
-  SimObject(const bool *powerSource) {
+  //! Walks a group, calling T::_updateDirect() on each member.
+  /*! T must make SimObject a friend and provide a non-virtual
+   *  _updateDirect(bool updateOutput).*/
+  template <class T>
+  static void _updateGroup(SimGroup &group, bool updateOutput) {
+    SimObject* buf = group.first;
+    while (buf != 0) {
+      _cursor = buf->_next;
+      if (buf->_scheduled()) {
+#ifdef SIMOBJECTS_PROFILE
+        unsigned long start = _profileBegin(buf);
+#endif
+        static_cast<T*>(buf)->_updateDirect(updateOutput);
+#ifdef SIMOBJECTS_PROFILE
+        _profileEnd(group, start);
+#endif
+      }
+      buf = _cursor;
+    }
+  }
+
+  SimObject(const bool *powerSource) :
+    _interval(0),
+    _lastRun(0),
+    _lapRun(_lap - 1),
+    _critical(false),
+    _rank(RankUnknown),
+    _sleep(Awake),
+    _busNext(0),
+    _busPrev(0),
+    _group(0),
+    _prev(0),
+    _next(0)
+  {
     setPowerSource(powerSource);
+#ifdef SIMOBJECTS_PROFILE
+    _profile.calls = _profile.total = _profile.max = 0;
+#endif
   }
 
-  virtual void _addToLinkedList(void);
+  //! Add to the group of objects updated through the virtual _update()
+  virtual void _addToLinkedList(void) { _addToGroup(_genericGroup); }
+
+  //! Add to the group updated by the given group's update function
+  void _addToGroup(SimGroup &group);
+
+  void _removeFromLinkedList(void);
   virtual void _setup (void) =0;
   virtual void _update(bool updateOutput = true) =0;
 
+  //! The i-th SimObject whose state this one reads, or 0 after the last.
+  /*! Only used by setup(), to update objects after their inputs.*/
+  virtual SimObject *_input(unsigned int /*i*/) { return 0; }
+
   //! Specifies if this object needs simulated power available to operate.
   bool _needsPower;
 
@@ -85,53 +347,517 @@ protected:
   /*! If _needsPower is set, this will be checked during update.*/
   const bool* _powerSource;
 
+  //! True if this object has simulated power, or does not need it
+  bool _powered(void) const { return !_needsPower || *_powerSource; }
+
+  //! Group for objects without one of their own, using virtual _update()
+  static SimGroup _genericGroup;
+
+  //! See setIncremental()
+  static bool _incremental;
+
+  //! Number of update() passes so far, for once-per-pass calculations
+  static unsigned long _passCount;
+
+  //! Update function for groups using the virtual _update()
+  static void _updateVirtual(SimGroup &group, bool updateOutput);
+
+  //! True if this object is to be updated in this pass. See setBudget().
+  bool _scheduled(void);
+
+#ifdef SIMOBJECTS_PROFILE
+  //! Note the object about to be updated, and return the start time
+  static unsigned long _profileBegin(SimObject *obj) {
+    _profiled = obj;
+    return SimHAL::profileNow();
+  }
+
+  //! Charge the time since start to the object and its group
+  static void _profileEnd(SimGroup &group, unsigned long start) {
+    unsigned long time = SimHAL::profileNow() - start;
+    // the object may have deleted itself
+    if (_profiled != 0)
+      _profiled->_profile.add(time);
+    group.profile.add(time);
+  }
+#endif
+
 private:
-  static SimObject* _first;
+  // SimObjects are linked into the registry by address, so are never copied
+  SimObject(const SimObject &);
+  SimObject & operator = (const SimObject &);
+
+  //! See setInterval()
+  unsigned int _interval;
+
+  //! Low bits of _passMillis when last updated, if _interval is set
+  unsigned int _lastRun;
+
+  //! Value of _lap when last updated under a budget
+  unsigned char _lapRun;
+
+  //! See setPriority()
+  bool _critical;
+
+  //! Depth among the inputs in this object's group, for setup()
+  unsigned char _rank;
+  enum { RankUnknown = 0, RankBusy = 0xFF };
+
+  //! Work out _rank, counting loops of inputs in _lagging
+  unsigned char _rankInGroup(void);
+
+  //! Order a group's members after their inputs in the group
+  static void _orderGroup(SimGroup &group);
+
+  //! Order the evaluation groups after the groups they read
+  static void _orderGroups(void);
+
+  //! Inputs of group's members in the groups from rest on, other than
+  //! group itself
+  static unsigned int _inputsIn(SimGroup &group, SimGroup *rest);
+
+  //! See lagging()
+  static unsigned int _lagging;
+
+  //! Power state pushed by a SimPowerBus
+  enum Sleep {
+    Awake,          //!< Updated as usual
+    SleepPending,   //!< Power lost: one more update to go dark, then sleep
+    Asleep          //!< Not updated until power returns
+  };
+  unsigned char _sleep;
+
+  //! Next object attached to the same SimPowerBus
+  SimObject* _busNext;
+
+  //! Link pointing to this object in its SimPowerBus list, or 0
+  SimObject** _busPrev;
+
+  void _detachFromBus(void) {
+    if (_busPrev == 0)
+      return;
+    *_busPrev = _busNext;
+    if (_busNext)
+      _busNext->_busPrev = _busPrev;
+    _busNext = 0;
+    _busPrev = 0;
+    _sleep = Awake;
+  }
+
+  friend class SimPowerBus;
+
+  //! See setBudget()
+  static unsigned long _budget;
+
+  //! Start of the current update() pass, if there is a budget
+  static unsigned long _passStart;
+
+  //! Low bits of millis() at the start of the current update() pass
+  static unsigned int _passMillis;
+
+  //! Counts rounds in which every object due has been updated once
+  static unsigned char _lap;
+
+  //! False if an object had to wait for a later pass in this one
+  static bool _lapDone;
+
+#ifdef SIMOBJECTS_PROFILE
+  SimProfile _profile;
+
+  //! Object being timed, cleared if it is removed meanwhile
+  static SimObject *_profiled;
+
+  //! Times of whole update() passes
+  static SimProfile _passProfile;
+  static unsigned long _passMin;
+
+  //! One line of profileReport()
+  static void _printProfile(Print &out, const SimProfile &p);
+#endif
+
+  //! First group in update order
+  static SimGroup* _firstGroup;
+
+  //! Group this object belongs to, or 0 if not in the update list
+  SimGroup* _group;
+  SimObject* _prev;
   SimObject* _next;
 
+  //! Next object to visit during setup() or update().
+  /*! Kept up to date when objects are added or removed mid-pass. */
+  static SimObject* _cursor;
+
+  //! Group being walked by setup() or update(), otherwise 0
+  static SimGroup* _walkGroup;
+
+  //! Insert a group into the update order
+  static void _linkGroup(SimGroup &group);
+
 };
 
 
 bool SimObject::hasPower = true;
-SimObject* SimObject::_first  = 0;
+SimGroup SimObject::_genericGroup = SIM_GROUP_INIT(&SimObject::_updateVirtual,
+                                                   SimObject::LevelGeneric,
+                                                   "SimObject");
+SimGroup* SimObject::_firstGroup = 0;
+SimObject* SimObject::_cursor    = 0;
+SimGroup* SimObject::_walkGroup  = 0;
+bool SimObject::_incremental     = false;
+unsigned long SimObject::_passCount = 0;
+unsigned int SimObject::_lagging    = 0;
+unsigned long SimObject::_budget     = 0;
+unsigned long SimObject::_passStart  = 0;
+unsigned int SimObject::_passMillis  = 0;
+unsigned char SimObject::_lap        = 0;
+bool SimObject::_lapDone             = true;
+#ifdef SIMOBJECTS_PROFILE
+SimObject* SimObject::_profiled      = 0;
+SimProfile SimObject::_passProfile   = { 0, 0, 0 };
+unsigned long SimObject::_passMin    = 0;
+#endif
 
 
 void SimObject::setup() {
-  if (_first != 0) {      // if at least one SimObject is instantiated
-    SimObject* buf = _first;
+#ifdef SIMOBJECTS_PROFILE
+  SimHAL::profileBegin();
+#endif
+  _lagging = 0;
+  _orderGroups();
+  for (SimGroup* g = _firstGroup; g != 0; g = g->next)
+    _orderGroup(*g);
+
+  for (SimGroup* g = _firstGroup; g != 0; g = g->next) {
+    _walkGroup = g;
+    SimObject* buf = g->first;
     while (buf != 0) {
+      _cursor = buf->_next;
       buf->_setup();
-      buf = buf->_next;
+      buf = _cursor;
     }
   }
+  _walkGroup = 0;
 }
 
 
 
 void SimObject::update( bool updateOutput) {
-  if (_first != 0) {      // if at least one SimObject is instantiated
-    SimObject* buf = _first;
-    while (buf != 0) {
+#ifdef SIMOBJECTS_PROFILE
+  unsigned long passStart = SimHAL::profileNow();
+#endif
+  ++_passCount;
+  _passMillis = SimHAL::millisNow();
+  if (_budget != 0)
+    _passStart = SimHAL::microsNow();
+  _lapDone = true;
+
+  // sample, evaluate and commit: the groups are in phase order
+  for (SimGroup* g = _firstGroup; g != 0; g = g->next) {
+    _walkGroup = g;
+    g->update(*g, updateOutput);
+  }
+  _walkGroup = 0;
+
+  // once everyone has had a turn, start another round
+  if (_lapDone)
+    ++_lap;
+
+#ifdef SIMOBJECTS_PROFILE
+  unsigned long time = SimHAL::profileNow() - passStart;
+  if (_passProfile.calls == 0 || time < _passMin)
+    _passMin = time;
+  _passProfile.add(time);
+#endif
+}
+
+
+
+#ifdef SIMOBJECTS_PROFILE
+void SimObject::_printProfile(Print &out, const SimProfile &p) {
+  out.print(F(" n="));
+  out.print(p.calls);
+  out.print(F(" total="));
+  out.print(p.total);
+  out.print(F(" avg="));
+  out.print(p.calls ? p.total / p.calls : 0);
+  out.print(F(" max="));
+  out.println(p.max);
+}
+
+
+void SimObject::profileReport(Print &out) {
+  out.print(F("SimObject profile, times in "));
+  out.println(F(SIMHAL_PROFILE_UNIT));
+  out.print(F("pass min="));
+  out.print(_passMin);
+  _printProfile(out, _passProfile);
+
+  for (SimGroup* g = _firstGroup; g != 0; g = g->next) {
+    out.print(g->name);
+    _printProfile(out, g->profile);
+    int i = 0;
+    for (SimObject* obj = g->first; obj != 0; obj = obj->_next, ++i) {
+      out.print(F("  #"));
+      out.print(i);
+      _printProfile(out, obj->_profile);
+    }
+  }
+}
+
+
+void SimObject::profileReset(void) {
+  SimProfile zero = { 0, 0, 0 };
+  _passProfile = zero;
+  _passMin = 0;
+  for (SimGroup* g = _firstGroup; g != 0; g = g->next) {
+    g->profile = zero;
+    for (SimObject* obj = g->first; obj != 0; obj = obj->_next)
+      obj->_profile = zero;
+  }
+}
+#endif
+
+
+
+void SimObject::_updateVirtual(SimGroup &group, bool updateOutput) {
+  SimObject* buf = group.first;
+  while (buf != 0) {
+    _cursor = buf->_next;
+    if (buf->_scheduled()) {
+#ifdef SIMOBJECTS_PROFILE
+      unsigned long start = _profileBegin(buf);
+#endif
       buf->_update(updateOutput);
-      buf = buf->_next;
+#ifdef SIMOBJECTS_PROFILE
+      _profileEnd(group, start);
+#endif
     }
+    buf = _cursor;
   }
 }
 
 
 
-void SimObject::_addToLinkedList(void) {
-  _next = 0;
+inline bool SimObject::_scheduled(void) {
+  // objects on an unpowered SimPowerBus are not visited at all
+  if (_sleep == Asleep)
+    return false;
+
+  if (_interval != 0 && (unsigned int)(_passMillis - _lastRun) < _interval)
+    return false;
+
+  if (_budget != 0 && !_critical) {
+    // already updated in this round, let the others catch up
+    if (_lapRun == _lap)
+      return false;
+    if (SimHAL::microsNow() - _passStart >= _budget) {
+      _lapDone = false;
+      return false;
+    }
+    _lapRun = _lap;
+  }
+
+  // this update takes the object dark; then it sleeps
+  if (_sleep == SleepPending)
+    _sleep = Asleep;
+
+  _lastRun = _passMillis;
+  return true;
+}
+
+
 
-  if (_first == 0) {  // then this must be the first object
-    _first = this;
-  } else {
-    // Go through linked list and make last existing element point to us
-    SimObject *a = _first;
-    while (a->_next)
-      a = a->_next;
-    a->_next = this;
+unsigned char SimObject::_rankInGroup(void) {
+  if (_rank == RankBusy) {
+    // a loop: this input is read before it is updated
+    ++_lagging;
+    return 0;
   }
+  if (_rank != RankUnknown)
+    return _rank;
+
+  _rank = RankBusy;
+  unsigned char rank = 1;
+  SimObject* in;
+  for (unsigned int i = 0; (in = _input(i)) != 0; ++i) {
+    if (in->_group != _group)
+      continue;
+    unsigned char r = in->_rankInGroup();
+    if (r >= rank && r < RankBusy - 1)
+      rank = r + 1;
+  }
+  _rank = rank;
+  return rank;
+}
+
+
+
+void SimObject::_orderGroup(SimGroup &group) {
+  unsigned char top = 0;
+  for (SimObject* obj = group.first; obj != 0; obj = obj->_next)
+    obj->_rank = RankUnknown;
+  for (SimObject* obj = group.first; obj != 0; obj = obj->_next) {
+    unsigned char r = obj->_rankInGroup();
+    if (r > top)
+      top = r;
+  }
+  if (top <= 1)
+    return;
+
+  // rebuild the list a rank at a time, keeping declaration order within
+  // each rank
+  SimObject* rest = group.first;
+  group.first = 0;
+  group.last = 0;
+  for (unsigned char r = 1; r <= top; ++r) {
+    SimObject** link = &rest;
+    while (*link != 0) {
+      SimObject* obj = *link;
+      if (obj->_rank != r) {
+        link = &obj->_next;
+        continue;
+      }
+      *link = obj->_next;
+      obj->_prev = group.last;
+      obj->_next = 0;
+      if (group.last == 0)
+        group.first = obj;
+      else
+        group.last->_next = obj;
+      group.last = obj;
+    }
+  }
+}
+
+
+
+unsigned int SimObject::_inputsIn(SimGroup &group, SimGroup *rest) {
+  unsigned int count = 0;
+  for (SimObject* obj = group.first; obj != 0; obj = obj->_next) {
+    SimObject* in;
+    for (unsigned int i = 0; (in = obj->_input(i)) != 0; ++i) {
+      if (in->_group == &group)
+        continue;
+      for (SimGroup* g = rest; g != 0; g = g->next) {
+        if (in->_group == g) {
+          ++count;
+          break;
+        }
+      }
+    }
+  }
+  return count;
+}
+
+
+
+void SimObject::_orderGroups(void) {
+  // sample groups stay first
+  SimGroup** link = &_firstGroup;
+  while (*link != 0 && (*link)->level < LevelInput)
+    link = &(*link)->next;
+
+  // take out the evaluation groups, leaving the commit groups
+  SimGroup* rest = 0;
+  SimGroup** restLink = &rest;
+  SimGroup* commit = *link;
+  while (commit != 0 && commit->level < LevelOutput) {
+    *restLink = commit;
+    restLink = &commit->next;
+    commit = commit->next;
+  }
+  *restLink = 0;
+
+  // put back the lowest-level group reading none of those left. If
+  // every group left reads another, they are in a loop: take the
+  // lowest, whose inputs in the others lag a pass.
+  while (rest != 0) {
+    SimGroup** pick = 0;
+    for (SimGroup** g = &rest; *g != 0; g = &(*g)->next) {
+      if (_inputsIn(**g, rest) == 0) {
+        pick = g;
+        break;
+      }
+    }
+    if (pick == 0) {
+      pick = &rest;
+      _lagging += _inputsIn(*rest, rest);
+    }
+    SimGroup* g = *pick;
+    *pick = g->next;
+    *link = g;
+    link = &g->next;
+  }
+  *link = commit;
+}
+
+
+
+void SimObject::_linkGroup(SimGroup &group) {
+  for (SimGroup* g = _firstGroup; g != 0; g = g->next) {
+    if (g == &group)
+      return;
+  }
+
+  SimGroup** link = &_firstGroup;
+  while (*link != 0 && (*link)->level <= group.level)
+    link = &(*link)->next;
+  group.next = *link;
+  *link = &group;
+}
+
+
+
+//! Append to a group. Objects added during a pass are visited in it.
+void SimObject::_addToGroup(SimGroup &group) {
+  if (_group != 0)
+    return;
+
+  // first member of a group puts the group into the update order
+  if (group.first == 0)
+    _linkGroup(group);
+
+  _group = &group;
+  _next = 0;
+  _prev = group.last;
+
+  if (group.last == 0)
+    group.first = this;
+  else
+    group.last->_next = this;
+  group.last = this;
+
+  // if the walk had reached the old end of this group, carry on to us
+  if (_walkGroup == &group && _cursor == 0)
+    _cursor = this;
+}
+
+
+
+void SimObject::_removeFromLinkedList(void) {
+#ifdef SIMOBJECTS_PROFILE
+  if (_profiled == this)
+    _profiled = 0;
+#endif
+  if (_group == 0)
+    return;
+
+  if (_cursor == this)
+    _cursor = _next;
+
+  if (_prev)
+    _prev->_next = _next;
+  else
+    _group->first = _next;
+
+  if (_next)
+    _next->_prev = _prev;
+  else
+    _group->last = _prev;
+
+  _group = 0;
+  _prev = 0;
+  _next = 0;
 }
 
 
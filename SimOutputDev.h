@@ -0,0 +1,390 @@
+
+// SimOutput Development Version
+
+/*
+     * Copyright 2012 Jack Deeth
+     * Contact: simulationelectronics@gmail.com
+     *
+     * Output stage for SimLEDs. LEDs write their state into the frame
+     * buffer of an output device, and each device sends its frame to the
+     * hardware once per SimObject::update(), touching only what changed.
+     *
+     * This program is free software: you can redistribute it and/or modify
+     * it under the terms of the GNU Lesser General Public License as
+     * published by the Free Software Foundation, either version 3 of the
+     * License, or (at your option) any later version.
+     *
+     * This program is distributed in the hope that it will be useful,
+     * but WITHOUT ANY WARRANTY; without even the implied warranty of
+     * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+     * GNU Lesser General Public License for more details.
+     *
+     * You should have received a copy of the GNU Lesser General Public
+     * License along with this program.
+     * If not, see <http://www.gnu.org/licenses/>.
+     *
+     * I would appreciate, but not insist, on attribution if this code is
+     * incorporated into other projects.
+     */
+
+#ifndef SIMOUTPUTDEV_H
+#define SIMOUTPUTDEV_H
+
+#include "SimObjectsDev.h"
+#include "SimTimerDev.h"
+
+//! Bits of a SimLED pin number giving the channel within an output.
+/*! The bits above select the output device: 0 is the board's own pins,
+ *  so ordinary Arduino pin numbers work unchanged.*/
+#define SIM_OUTPUT_CHANNEL_BITS 9
+
+//! Number of 8-bit ports SimPortOutput can batch. At most 32.
+#ifndef SIM_OUTPUT_PORTS
+#define SIM_OUTPUT_PORTS 16
+#endif
+
+SIM_STATIC_ASSERT(SIM_OUTPUT_PORTS <= 32, SIM_OUTPUT_PORTS_too_large);
+
+
+//! Somewhere SimLEDs can send their state.
+/*! An output keeps a frame of the states written to it and sends it to
+ *  the hardware from its _flush(). Outputs are updated after every other
+ *  SimObject, so each frame is sent once per SimObject::update(), and
+ *  not at all if update() is called with updateOutput false. See
+ *  setCommitRate() for sending frames from a timer interrupt instead.
+ *
+ *  SimLEDs reach channel n of an output through the pin number pin(n).
+ */
+class SimOutput : public SimObject {
+public:
+  //! Pin number for a SimLED driven by channel n of this output
+  int pin(unsigned int n) const {
+    return (_id << SIM_OUTPUT_CHANNEL_BITS) | n;
+  }
+
+  //! Convert channel number n to the handle used by write().
+  /*! Returns false if there is no such channel.*/
+  virtual bool channel(unsigned int n, unsigned int &handle) {
+    handle = n;
+    return true;
+  }
+
+  //! Prepare a channel for output. Called from SimObject::setup().
+  virtual void setupChannel(unsigned int /*handle*/) {}
+
+  //! Set a channel's state in the frame
+  virtual void write(unsigned int handle, bool state) =0;
+
+  //! Find the output and channel handle for a SimLED pin number.
+  /*! Returns 0 if the pin is negative or there is no such output.*/
+  static SimOutput *find(int pin, unsigned int &handle);
+
+  //! Send frames from a timer interrupt, rate times a second.
+  /*! SimObject::update() then only hands each complete frame over, and
+   *  the interrupt sends the latest at a fixed rate, however long
+   *  FlightSim.update() and the rest of loop() took. Outputs which
+   *  cannot be driven from an interrupt, on the SPI or I2C buses, still
+   *  send from update(). 0 (the default) sends everything from update().
+   *  Returns false if the board has no SimHAL timer, or SIM_USE_TIMER
+   *  was not defined before the SimObjects headers (see SimTimerDev.h).
+   *
+   *  Servos need no such mode: the Servo library already sends their
+   *  pulses from its own timer.*/
+  static bool setCommitRate(unsigned int rate) {
+    _commitRate = rate;
+    if (_startTimer())
+      return true;
+    // no timer, so keep sending from update()
+    _commitRate = 0;
+    return false;
+  }
+
+  ~SimOutput();
+
+protected:
+  SimOutput();
+
+  //! Send the frame to the hardware
+  virtual void _flush(void) =0;
+
+  //! True if this output's frames may be sent from the timer interrupt
+  /*! Such outputs provide _publish() and _commit().*/
+  bool _timerCommit;
+
+  //! Hand the frame written this pass to _commit().
+  /*! Called from update() with the timer interrupt held off.*/
+  virtual void _publish(void) {}
+
+  //! Send the last frame published. Called from the timer interrupt.
+  virtual void _commit(void) {}
+
+  void _setup(void) {}
+  void _update(bool updateOutput = true) {
+    if (!updateOutput)
+      return;
+    if (_commitRate != 0 && _timerCommit) {
+      SimHAL::timerHold();
+      _publish();
+      SimHAL::timerRelease();
+    } else
+      _flush();
+  }
+
+  //! Run scan from the timer interrupt every period microseconds, or
+  //! stop it if scan is 0. Commits share the same timer.
+  static bool _setScan(void (*scan)(void), unsigned long period) {
+    _scan = scan;
+    _scanPeriod = period;
+    return _startTimer();
+  }
+
+  //! Group of all outputs, updated after every other SimObject
+  static SimGroup _outputGroup;
+
+private:
+  //! Selects this output in pin numbers
+  unsigned char _id;
+
+  SimOutput *_nextOutput;
+  static SimOutput *_firstOutput;
+  static unsigned char _outputCount;
+
+  //! See setCommitRate()
+  static unsigned int _commitRate;
+
+  //! Scan run on every timer tick, see _setScan()
+  static void (*_scan)(void);
+  static unsigned long _scanPeriod;
+
+  //! Timer ticks between commits, and ticks since the last
+  static unsigned int _commitTicks;
+  static volatile unsigned int _tickCount;
+
+  //! Start, restart or stop the timer for the scan and commits
+  static bool _startTimer(void);
+
+  //! Timer interrupt handler
+  static void _tick(void);
+};
+
+
+SimGroup SimOutput::_outputGroup = SIM_GROUP_INIT(&SimObject::_updateVirtual,
+                                                  SimObject::LevelOutput,
+                                                  "SimOutput");
+SimOutput *SimOutput::_firstOutput  = 0;
+unsigned char SimOutput::_outputCount = 0;
+unsigned int SimOutput::_commitRate   = 0;
+void (*SimOutput::_scan)(void)        = 0;
+unsigned long SimOutput::_scanPeriod  = 0;
+unsigned int SimOutput::_commitTicks  = 0;
+volatile unsigned int SimOutput::_tickCount = 0;
+
+
+SimOutput::SimOutput() :
+  SimObject(0),
+  _timerCommit(false),
+  _id(_outputCount++),
+  _nextOutput(0)
+{
+  // frames must go out every pass, whatever the time budget
+  setPriority(PriorityCritical);
+
+  SimOutput **link = &_firstOutput;
+  while (*link != 0)
+    link = &(*link)->_nextOutput;
+  *link = this;
+  _addToGroup(_outputGroup);
+}
+
+
+SimOutput::~SimOutput() {
+  // the timer interrupt walks the list
+  SimHAL::timerHold();
+  for (SimOutput **link = &_firstOutput; *link != 0;
+       link = &(*link)->_nextOutput) {
+    if (*link == this) {
+      *link = _nextOutput;
+      break;
+    }
+  }
+  SimHAL::timerRelease();
+}
+
+
+bool SimOutput::_startTimer(void) {
+  unsigned long commitPeriod = _commitRate ? 1000000UL / _commitRate : 0;
+  unsigned long period;
+  if (_scan != 0) {
+    // commit every so many scan ticks
+    period = _scanPeriod;
+    _commitTicks = commitPeriod ? (commitPeriod + period / 2) / period : 0;
+    if (commitPeriod && _commitTicks == 0)
+      _commitTicks = 1;
+  } else if (commitPeriod != 0) {
+    period = commitPeriod;
+    _commitTicks = 1;
+  } else {
+    SimHAL::timerEnd();
+    return true;
+  }
+  _tickCount = 0;
+  return SimHAL::timerBegin(&SimOutput::_tick, period);
+}
+
+
+void SimOutput::_tick(void) {
+  if (_scan != 0)
+    _scan();
+  if (_commitTicks != 0 && ++_tickCount >= _commitTicks) {
+    _tickCount = 0;
+    for (SimOutput *out = _firstOutput; out != 0; out = out->_nextOutput) {
+      if (out->_timerCommit)
+        out->_commit();
+    }
+  }
+}
+
+
+SimOutput *SimOutput::find(int pin, unsigned int &handle) {
+  if (pin < 0)
+    return 0;
+  unsigned char id = pin >> SIM_OUTPUT_CHANNEL_BITS;
+  unsigned int n = pin & ((1 << SIM_OUTPUT_CHANNEL_BITS) - 1);
+  for (SimOutput *out = _firstOutput; out != 0; out = out->_nextOutput) {
+    if (out->_id == id)
+      return out->channel(n, handle) ? out : 0;
+  }
+  return 0;
+}
+
+
+
+
+//! The board's own pins, written a port at a time.
+/*! Channels are Arduino pin numbers. Writes only change the frame; at
+ *  flush, each port with changed pins gets a single
+ *  SimHAL::writePortBits() of just those pins. Pins on ports beyond
+ *  SIM_OUTPUT_PORTS are written individually, at the time of the write.
+ *
+ *  SimLEDs given a plain pin number use SimPortOutput::gpio.
+ */
+class SimPortOutput : public SimOutput {
+public:
+  SimPortOutput() : _dirtyPorts(0), _readyPorts(0) {
+    for (int i = 0; i < SIM_OUTPUT_PORTS; ++i) {
+      _frame[i] = 0;
+      _ready[i] = 0;
+      _shown[i] = 0;
+    }
+    _timerCommit = true;
+  }
+
+  bool channel(unsigned int n, unsigned int &handle) {
+    unsigned char port, mask;
+    if (!SimHAL::pinPort(n, port, mask))
+      return false;
+    if (port < SIM_OUTPUT_PORTS)
+      handle = (port << 8) | mask;
+    else
+      handle = _Direct | n;
+    return true;
+  }
+
+  void setupChannel(unsigned int handle) {
+    if (handle & _Direct) {
+      SimHAL::outputPin(handle & ~_Direct);
+      return;
+    }
+    unsigned char port = handle >> 8;
+    unsigned char mask = handle;
+    SimHAL::outputPortBits(port, mask);
+    // bring the pin into line with the frame, so later flushes can
+    // skip it until it changes
+    SimHAL::timerHold();
+    SimHAL::writePortBits(port, mask, _frame[port]);
+    _shown[port] = (_shown[port] & ~mask) | (_frame[port] & mask);
+    SimHAL::timerRelease();
+  }
+
+  void write(unsigned int handle, bool state) {
+    if (handle & _Direct) {
+      SimHAL::writePin(handle & ~_Direct, state);
+      return;
+    }
+    unsigned char port = handle >> 8;
+    unsigned char mask = handle;
+    unsigned char bits = state ? _frame[port] | mask : _frame[port] & ~mask;
+    if (bits != _frame[port]) {
+      _frame[port] = bits;
+      _dirtyPorts |= 1UL << port;
+    }
+  }
+
+  //! Output used for ordinary pin numbers
+  static SimPortOutput gpio;
+
+private:
+  //! Handle flag for pins written without batching
+  enum { _Direct = 0x8000 };
+
+  //! Pin states wanted, per port
+  unsigned char _frame[SIM_OUTPUT_PORTS];
+
+  //! Pin states last written to the hardware, per port
+  unsigned char _shown[SIM_OUTPUT_PORTS];
+
+  //! Ports whose frame has changed since the last flush, one bit each
+  unsigned long _dirtyPorts;
+
+  //! Frame published for the timer interrupt to commit, and its ports
+  //! not yet committed. See SimOutput::setCommitRate().
+  volatile unsigned char _ready[SIM_OUTPUT_PORTS];
+  volatile unsigned long _readyPorts;
+
+  void _flush(void) {
+    // anything published but not committed before commits stopped
+    _dirtyPorts |= _readyPorts;
+    _readyPorts = 0;
+    for (unsigned char port = 0; _dirtyPorts != 0; ++port) {
+      if (_dirtyPorts & 1) {
+        unsigned char changed = _frame[port] ^ _shown[port];
+        if (changed) {
+          SimHAL::writePortBits(port, changed, _frame[port]);
+          _shown[port] = _frame[port];
+        }
+      }
+      _dirtyPorts >>= 1;
+    }
+  }
+
+  void _publish(void) {
+    unsigned long ports = _dirtyPorts;
+    for (unsigned char port = 0; ports != 0; ++port, ports >>= 1) {
+      if (ports & 1)
+        _ready[port] = _frame[port];
+    }
+    _readyPorts |= _dirtyPorts;
+    _dirtyPorts = 0;
+  }
+
+  void _commit(void) {
+    unsigned long ports = _readyPorts;
+    for (unsigned char port = 0; ports != 0; ++port, ports >>= 1) {
+      if (ports & 1) {
+        unsigned char bits = _ready[port];
+        unsigned char changed = bits ^ _shown[port];
+        if (changed) {
+          SimHAL::writePortBits(port, changed, bits);
+          _shown[port] = bits;
+        }
+      }
+    }
+    _readyPorts = 0;
+  }
+};
+
+
+SimPortOutput SimPortOutput::gpio;
+
+
+#endif // SIMOUTPUTDEV_H
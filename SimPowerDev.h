@@ -0,0 +1,210 @@
+
+// SimPower Development Version
+
+/*
+     * Copyright 2012 Jack Deeth
+     * Contact: simulationelectronics@gmail.com
+     *
+     * Simulated electrical buses and breakers. SimObjects attached to a
+     * bus are told when it loses or regains power, and are not updated
+     * at all while it is dead.
+     *
+     * This program is free software: you can redistribute it and/or modify
+     * it under the terms of the GNU Lesser General Public License as
+     * published by the Free Software Foundation, either version 3 of the
+     * License, or (at your option) any later version.
+     *
+     * This program is distributed in the hope that it will be useful,
+     * but WITHOUT ANY WARRANTY; without even the implied warranty of
+     * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+     * GNU Lesser General Public License for more details.
+     *
+     * You should have received a copy of the GNU Lesser General Public
+     * License along with this program.
+     * If not, see <http://www.gnu.org/licenses/>.
+     *
+     * I would appreciate, but not insist, on attribution if this code is
+     * incorporated into other projects.
+     */
+
+#ifndef SIMPOWERDEV_H
+#define SIMPOWERDEV_H
+
+#include "SimObjectsDev.h"
+#include "SimDataRefDev.h"
+
+//! A named electrical bus, fed through a breaker.
+/*! A bus is fed by a bool (SimObject::hasPower, or any logic of your
+ *  own), by a float dataref such as a bus voltage, or by another bus.
+ *  It is live while its feed is and its breaker is closed.
+ *
+ *  Buses are updated before every other SimObject, and only look at
+ *  their feed: the objects attached to a bus are told when its state
+ *  changes. On losing power each attached object is updated once more,
+ *  so LEDs go dark and servos move to rest, and is then skipped by
+ *  SimObject::update() until power returns.
+ *  \code
+ *  DataRefIdent battVoltsIdent[] = "sim/cockpit2/electrical/bus_volts[0]";
+ *  DataRefIdent lowVoltsIdent[] = "sim/cockpit2/annunciators/low_voltage";
+ *
+ *  SimPowerBus battBus("BATT", battVoltsIdent, 18);
+ *  SimPowerBus ovhdBus("OVHD", battBus);
+ *
+ *  SimLEDIntDR lowVolts(12, lowVoltsIdent);
+ *  ...
+ *  ovhdBus.attach(lowVolts);
+ *  ...
+ *  ovhdBus.setBreaker(breakerButton.read() == HIGH);
+ *  \endcode
+ */
+class SimPowerBus : public SimObject {
+public:
+  //! Bus live while *feed is true
+  SimPowerBus(const char *name, const bool *feed)
+    : SimObject(0), _source(SourceBool), _feed(feed), _dr(0), _minimum(0),
+      _parent(0)
+  { _init(name); }
+
+  //! Bus live while the float dataref ident is at least minimum.
+  //! ident is a DataRefIdent, or from SIM_DATAREF_TABLE, in program
+  //! memory.
+  SimPowerBus(const char *name, const char *ident, float minimum)
+    : SimObject(0), _source(SourceDataRef),
+      _feed(0), _dr(&SimDataRefs::floatRef(ident)), _minimum(minimum),
+      _parent(0)
+  { _init(name); }
+
+  //! Bus fed from parent
+  SimPowerBus(const char *name, SimPowerBus &parent)
+    : SimObject(0), _source(SourceBus), _feed(&parent._state), _dr(0),
+      _minimum(0), _parent(&parent)
+  { _init(name); }
+
+  //! Power obj from this bus, in place of its previous power source
+  void attach(SimObject &obj) {
+    obj.setPowerSource(&_state);
+    obj._busNext = _attached;
+    obj._busPrev = &_attached;
+    if (_attached)
+      _attached->_busPrev = &obj._busNext;
+    _attached = &obj;
+    obj._sleep = _state ? Awake : SleepPending;
+  }
+
+  //! Open (trip) or close (reset) this bus's breaker. Closed by default.
+  void setBreaker(bool closed) { _breakerClosed = closed; }
+
+  //! Follow *closed, such as a switch state kept by the sketch, as the
+  //! breaker rather than setBreaker(). 0 goes back to setBreaker().
+  void followBreaker(const bool *closed) {
+    _breaker = closed ? closed : &_breakerClosed;
+  }
+
+  bool breakerClosed(void) const { return *_breaker; }
+
+  //! True if this bus is live, as of the current update() pass
+  bool isPowered(void) const { return _state; }
+
+  const char *name(void) const { return _name; }
+
+  //! Number of objects attached
+  unsigned int attached(void) const {
+    unsigned int count = 0;
+    for (SimObject *obj = _attached; obj != 0; obj = obj->_busNext)
+      ++count;
+    return count;
+  }
+
+  //! Print each bus's name, state, breaker and attached object count
+  static void report(Print &out);
+
+  //! Attached objects keep the bus's last state
+  ~SimPowerBus() {
+    while (_attached != 0)
+      _attached->setPowerSource(_state ? 0 : &_deadBus);
+  }
+
+private:
+  enum Source { SourceBool, SourceDataRef, SourceBus };
+  unsigned char _source;
+
+  //! Feed for SourceBool and SourceBus
+  const bool *_feed;
+
+  //! Feed for SourceDataRef, live from _minimum up
+  FlightSimFloat *_dr;
+  float _minimum;
+
+  //! Feeding bus for SourceBus, updated first
+  SimPowerBus *_parent;
+
+  const char *_name;
+
+  bool _state;
+  bool _breakerClosed;
+  const bool *_breaker;
+
+  //! First attached object, linked through SimObject::_busNext
+  SimObject *_attached;
+
+  //! Power source for objects left by a dead bus being destroyed
+  static const bool _deadBus;
+
+  void _init(const char *name) {
+    _name = name;
+    _state = false;
+    _breakerClosed = true;
+    _breaker = &_breakerClosed;
+    _attached = 0;
+    _addToGroup(_typeGroup);
+  }
+
+  SimObject *_input(unsigned int i) { return i == 0 ? _parent : 0; }
+
+  //! A bus always needs its dataref
+  void _setup(void) {
+    if (_source == SourceDataRef)
+      SimDataRefs::subscribe(*_dr);
+  }
+
+  void _update(bool /*updateOutput*/ = true) {
+    bool fed;
+    if (_source == SourceDataRef)
+      fed = (float)*_dr >= _minimum;
+    else
+      fed = *_feed;
+    bool state = fed && *_breaker;
+    if (state == _state)
+      return;
+
+    // tell the objects on the bus
+    _state = state;
+    for (SimObject *obj = _attached; obj != 0; obj = obj->_busNext)
+      obj->_sleep = state ? Awake : SleepPending;
+  }
+
+  friend class SimObject;
+  static SimGroup _typeGroup;
+  void _updateDirect(bool updateOutput) { SimPowerBus::_update(updateOutput); }
+};
+
+
+// before everything they power
+SimGroup SimPowerBus::_typeGroup = SIM_GROUP(SimPowerBus, SimObject::LevelPower);
+const bool SimPowerBus::_deadBus = false;
+
+
+
+void SimPowerBus::report(Print &out) {
+  for (SimObject *obj = _typeGroup.first; obj != 0; obj = obj->_next) {
+    SimPowerBus *bus = static_cast<SimPowerBus*>(obj);
+    out.print(bus->_name);
+    out.print(bus->_state ? F(" live") : F(" dead"));
+    out.print(bus->breakerClosed() ? F(" breaker=closed") : F(" breaker=open"));
+    out.print(F(" attached="));
+    out.println(bus->attached());
+  }
+}
+
+
+#endif // SIMPOWERDEV_H
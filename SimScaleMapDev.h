@@ -0,0 +1,245 @@
+
+// SimScaleMap Development Version
+
+/*
+     * Copyright 2012 Jack Deeth
+     * Contact: simulationelectronics@gmail.com
+     *
+     * Piecewise-linear input-to-output maps, converted once into
+     * fixed-point segments so that each lookup is a binary search and an
+     * integer multiply-add.
+     *
+     * This program is free software: you can redistribute it and/or modify
+     * it under the terms of the GNU Lesser General Public License as
+     * published by the Free Software Foundation, either version 3 of the
+     * License, or (at your option) any later version.
+     *
+     * This program is distributed in the hope that it will be useful,
+     * but WITHOUT ANY WARRANTY; without even the implied warranty of
+     * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+     * GNU Lesser General Public License for more details.
+     *
+     * You should have received a copy of the GNU Lesser General Public
+     * License along with this program.
+     * If not, see <http://www.gnu.org/licenses/>.
+     *
+     * I would appreciate, but not insist, on attribution if this code is
+     * incorporated into other projects.
+     */
+
+#ifndef SIMSCALEMAPDEV_H
+#define SIMSCALEMAPDEV_H
+
+#include "SimObjectsDev.h"
+
+//! Input/output pairs for conversion
+typedef const double ScaleMap [][2];
+
+#if __cplusplus >= 201103L
+//! True if a ScaleMap has at least two pairs with increasing inputs.
+/*! C++11 and later only. Lets a map declared constexpr be checked when
+ *  the sketch is compiled:
+ *  \code
+ *  constexpr double oilMap[][2] = { {0, 0}, {50, 90}, {100, 180} };
+ *  static_assert(simScaleMapOrdered(oilMap), "oilMap out of order");
+ *  \endcode
+ */
+template <size_t N>
+constexpr bool simScaleMapOrdered(const double (&map)[N][2],
+                                  size_t i = 1) {
+  return N >= 2 && (i >= N || (map[i-1][0] <= map[i][0]
+                               && simScaleMapOrdered(map, i + 1)));
+}
+#endif
+
+//! Most pairs in a ScaleMap looked up in fixed point. Every SimScaleMap
+//! holds the segments for a map this long, 7 bytes per pair, so define
+//! it before including the SimObjects headers to suit the panel's
+//! longest map.
+#ifndef SIM_SCALEMAP_PAIRS
+#define SIM_SCALEMAP_PAIRS 6
+#endif
+
+SIM_STATIC_ASSERT(SIM_SCALEMAP_PAIRS >= 2 && SIM_SCALEMAP_PAIRS <= 255,
+                  SIM_SCALEMAP_PAIRS_out_of_range);
+
+
+//! A ScaleMap prepared for fast lookup.
+/*! Inputs are offset and scaled onto 0..65535, and outputs are held as
+ *  integers scaled by 2^outShift(). Each segment between two pairs keeps
+ *  its start point and a slope with its own binary point, so lookup()
+ *  needs no division and no floating point beyond scaling the input.
+ *
+ *  The segments are held in the SimScaleMap itself, so a panel's maps
+ *  are laid out in static storage with the objects owning them. A map
+ *  longer than SIM_SCALEMAP_PAIRS, or too steep for 16-bit slopes, is
+ *  interpolated in floating point instead; isFixed() tells which. The
+ *  SimServo and SimAnalogIn constructors taking a ScaleMap array refuse
+ *  to compile with one longer than SIM_SCALEMAP_PAIRS.
+ */
+class SimScaleMap {
+public:
+  SimScaleMap() : _map(0), _fixed(false), _pairs(0), _outShift(0) {}
+
+  //! Prepare map. Returns false unless it has at least two pairs with
+  //! increasing inputs.
+  bool init(const double (*map)[2], unsigned int pairs);
+
+  //! Output for in, scaled by 2^outShift(). Clamped to the ends of the map.
+  long lookup(float in) const {
+    if (!(in > _inMin))
+      return _outFirst;
+    if (in >= _inMax)
+      return _outLast;
+
+    uint16_t x = (uint16_t)((in - _inMin) * _inScale);
+
+    // find the last segment starting at or before x
+    if (_fixed) {
+      unsigned char lo = 0;
+      unsigned char hi = _pairs - 2;
+      while (lo < hi) {
+        unsigned char mid = (lo + hi + 1) >> 1;
+        if (_segs[mid].x <= x)
+          lo = mid;
+        else
+          hi = mid - 1;
+      }
+      const Segment &s = _segs[lo];
+      long dy = (long)(uint16_t)(x - s.x) * s.slope;
+      if (s.shift)
+        dy = (dy + (1L << (s.shift - 1))) >> s.shift;
+      return s.y + dy;
+    }
+    return _lookupDouble(in);
+  }
+
+  //! Binary places in lookup() results
+  unsigned char outShift(void) const { return _outShift; }
+
+  //! True if lookups use fixed-point segments
+  bool isFixed(void) const { return _fixed; }
+
+private:
+  //! Part of the map between one pair and the next
+  struct Segment {
+    uint16_t x;           //!< Scaled input at start
+    int16_t y;            //!< Scaled output at start
+    int16_t slope;        //!< Output per input step, times 2^shift
+    unsigned char shift;  //!< Binary places in slope
+  };
+
+  //! Original map, used when not fixed point
+  const double (*_map)[2];
+
+  //! This map's segments, if _fixed
+  Segment _segs[SIM_SCALEMAP_PAIRS - 1];
+  bool _fixed;
+
+  unsigned char _pairs;
+  unsigned char _outShift;
+
+  float _inMin;
+  float _inMax;
+
+  //! Input steps per input unit
+  float _inScale;
+
+  //! Scaled outputs for inputs off either end of the map
+  long _outFirst;
+  long _outLast;
+
+  long _lookupDouble(float in) const;
+
+  //! Input on the 0..65535 scale used by lookup()
+  double _scaleIn(double in) const {
+    in = (in - _inMin) * _inScale;
+    return in < 0 ? 0 : in > 65535 ? 65535 : in;
+  }
+
+  long _scaleOut(double out) const {
+    out *= (double)(1L << _outShift);
+    return (long)(out < 0 ? out - 0.5 : out + 0.5);
+  }
+};
+
+
+
+bool SimScaleMap::init(const double (*map)[2], unsigned int pairs) {
+  if (pairs < 2 || pairs > 255)
+    return false;
+  for (unsigned int i = 1; i < pairs; ++i) {
+    if (map[i][0] < map[i-1][0])
+      return false;
+  }
+
+  _map = map;
+  _pairs = pairs;
+  _inMin = map[0][0];
+  _inMax = map[pairs-1][0];
+  _inScale = (_inMax > _inMin) ? 65535.0 / (_inMax - _inMin) : 0;
+
+  // as many binary places as keep every output within 16 bits
+  double maxOut = 0;
+  for (unsigned int i = 0; i < pairs; ++i) {
+    double out = map[i][1] < 0 ? -map[i][1] : map[i][1];
+    if (out > maxOut)
+      maxOut = out;
+  }
+  _outShift = 0;
+  while (_outShift < 14 && maxOut * (2L << _outShift) < 32767)
+    ++_outShift;
+
+  _outFirst = _scaleOut(map[0][1]);
+  _outLast  = _scaleOut(map[pairs-1][1]);
+
+  _fixed = false;
+  if (maxOut * (1L << _outShift) >= 32767 || pairs > SIM_SCALEMAP_PAIRS)
+    return true;
+
+  for (unsigned int i = 0; i + 1 < pairs; ++i) {
+    Segment &s = _segs[i];
+    double x0 = _scaleIn(map[i][0]);
+    double x1 = _scaleIn(map[i+1][0]);
+    s.x = (uint16_t)(x0 + 0.5);
+    s.y = _scaleOut(map[i][1]);
+    s.shift = 0;
+    s.slope = 0;
+
+    long dy = _scaleOut(map[i+1][1]) - s.y;
+    if (dy != 0 && x1 - x0 >= 0.5) {
+      double slope = dy / (x1 - x0);
+      if (slope >= 32767 || slope <= -32767)
+        return true;    // too steep for 16 bits, stay in floating point
+      while (s.shift < 30 && slope < 16383 && slope > -16383) {
+        slope *= 2;
+        ++s.shift;
+      }
+      s.slope = (int16_t)(slope < 0 ? slope - 0.5 : slope + 0.5);
+    }
+  }
+
+  _fixed = true;
+  return true;
+}
+
+
+
+long SimScaleMap::_lookupDouble(float in) const {
+  unsigned char lo = 0;
+  unsigned char hi = _pairs - 2;
+  while (lo < hi) {
+    unsigned char mid = (lo + hi + 1) >> 1;
+    if (_map[mid][0] <= in)
+      lo = mid;
+    else
+      hi = mid - 1;
+  }
+  double out = _map[lo+1][0] - _map[lo][0];
+  if (out > 0)
+    out = (in - _map[lo][0]) / out * (_map[lo+1][1] - _map[lo][1]);
+  return _scaleOut(_map[lo][1] + out);
+}
+
+
+#endif // SIMSCALEMAPDEV_H
@@ -31,11 +31,10 @@
 
 
 #include "SimObjectsDev.h"
+#include "SimScaleMapDev.h"
+#include "SimDataRefDev.h"
 
 
-//! Input/output pairs for conversion
-typedef const double ScaleMap [][2];
-
 class SimServo : public SimObject {
 public:
   //! Constructor for when we need to convert the dataref into an angle.
@@ -67,16 +66,27 @@ public:
     SimObject(hasPowerFlag),
     _pin(pin)
   {
-    _dr.assign((const _XpRefStr_ *) &ident[0]);
-    _map = map;
-    _mapPair =  sizeof_map / (2*sizeof(double));
-
-    _mapValid = _validateMap();
-
-    if(_mapValid)
-      _addToLinkedList();
+    _init(ident, map, sizeof_map / (2*sizeof(double)), restAngle);
+  }
 
-    _restAngle = restAngle;
+  //! Constructor taking the ScaleMap array directly
+  /*! The number of pairs is taken from the ScaleMap's declaration, and
+   *  a map with fewer than two pairs, or more than SIM_SCALEMAP_PAIRS,
+   *  is a compile error. Other parameters are as above.
+   */
+  template <size_t N>
+  SimServo (const unsigned short &pin,
+            const char * ident,
+            const double (&map)[N][2],
+            const int restAngle = -1,
+            const bool *hasPowerFlag = &SimObject::hasPower
+            ) :
+    SimObject(hasPowerFlag),
+    _pin(pin)
+  {
+    SIM_STATIC_ASSERT(N >= 2, ScaleMap_needs_at_least_two_pairs);
+    SIM_STATIC_ASSERT(N <= SIM_SCALEMAP_PAIRS, ScaleMap_longer_than_SIM_SCALEMAP_PAIRS);
+    _init(ident, map, N, restAngle);
   }
 
   //! Constructor where the dataref is already a suitable angle
@@ -95,7 +105,9 @@ public:
   /*! This value is converted from _in via _map but does not have any
    *  power-simulation effects added.
    */
-  double getAngle(void) { return _out; }
+  double getAngle(void) {
+    return (double)_out / (double)(1L << _scale->outShift());
+  }
 
   //! Returns computed servo angle
   /*! This is the integer value fed to the servo through the Arduino
@@ -111,39 +123,74 @@ private:
    */
   int _restAngle;
 
-  //! To clarify accessing indexes of _map.
-  enum ScaleMapIndex {
-    In,
-    Out
-  };
-
   //! Input value
   double _in;
 
-  //! Result of passing _in through _map
-  double _out;
+  //! Result of passing _in through _scale, scaled by 2^_scale->outShift()
+  long _out;
 
   //! _out with power simulation effects added, and converted to integer
   int _servoAngle;
 
-  //! Check ScaleMap input to see that input values are in increasing order
-  bool _validateMap(void);
+  //! True until the first _update()
+  bool _dirty;
+
+  //! True if the last _update() wrote _servoAngle to the servo
+  bool _written;
+
+  //! Power and X-Plane link state at the last _update()
+  bool _lastPowered;
+  bool _lastEnabled;
+
+  //! Shared constructor body. A servo given share uses share's prepared
+  //! map rather than preparing map again.
+  void _init(const char * ident,
+             ScaleMap map,
+             unsigned int mapPairs,
+             int restAngle,
+             const SimServo *share = 0) {
+    _dr = &SimDataRefs::floatRef(ident);
+    _in = 0;
+    _out = 0;
+    _servoAngle = 0;
+    _dirty = true;
+    _written = false;
+    _lastPowered = false;
+    _lastEnabled = false;
+
+    if (share != 0) {
+      _scale = share->_scale;
+      _mapValid = share->_mapValid;
+    } else {
+      _scale = &_map;
+      _mapValid = _map.init(map, mapPairs);
+    }
+
+    if(_mapValid)
+      _addToGroup(_typeGroup);
 
-  //! If false, no _setup or _update occurs. Stores result of _validateMap().
+    _restAngle = restAngle;
+  }
+
+  //! If false, no _setup or _update occurs. Set if _scale->init()
+  //! accepted the map.
   bool _mapValid;
 
   //! Number of Arduino pin connected to servo.
-  const unsigned short _pin;
+  unsigned short _pin;
+
+  //! Input dataref, shared with other objects reading it
+  FlightSimFloat *_dr;
 
-  //! Input dataref
-  FlightSimFloat _dr;
+  //! Element of a SimServoArray, which calls _init()
+  SimServo() : SimObject(&SimObject::hasPower), _pin(0) {}
+  template <unsigned char N> friend class SimServoArray;
 
-  //! Pointer to input-to-output conversion map
-  const double (*_map)[2];
+  //! Input-to-output conversion map
+  SimScaleMap _map;
 
-  //! Number of input/output pairs in _map.
-  /*! Reliant on unmangled (map, sizeof(map)) arguments in constructor.*/
-  unsigned int _mapPair;
+  //! Map in use: _map, or the first element's in a SimServoArray
+  const SimScaleMap *_scale;
 
   //! Ordinary Arduino Servo object, which actually moves the servo
   Servo _servo;
@@ -156,64 +203,89 @@ private:
   //! Run update routines on this class instance.
   void _update (bool updateOutput = true);
 
+  friend class SimObject;
+  static SimGroup _typeGroup;
+  void _updateDirect(bool updateOutput) {
+    // in incremental mode, skip if input, power and link are unchanged
+    // and the servo already has the angle they give. The input is not
+    // read without power.
+    if (_incremental && !_dirty
+        && _powered() == _lastPowered
+        && (!_lastPowered || (float)*_dr == _in)
+        && SimHAL::simEnabled() == _lastEnabled
+        && (_written || !_lastEnabled))
+      return;
+    SimServo::_update(updateOutput);
+  }
+
 };
 
 
+SimGroup SimServo::_typeGroup = SIM_GROUP(SimServo, SimObject::LevelInput);
 
-//! Check we have at least two pairs and inputs are in increasing order
-bool SimServo::_validateMap(void) {
 
-  if (_mapPair < 2) {
-    return false;
-  }
 
-  // each input must be greater than the previous input
-  for(unsigned int i = 1; i < _mapPair; ++i) {
-    if (_map[i][In] < _map[i-1][In]) {
-      return false;
+//! N SimServos on the elements of one array dataref, such as a gauge
+//! per engine.
+/*! Every servo uses the same ScaleMap and rest angle, and the elements
+ *  are declared with one SIM_DATAREF_ARRAY identifier. The map is
+ *  prepared once, by the first element, and shared by the rest.
+ *  \code
+ *  SIM_DATAREF_ARRAY(n1Ident, "sim/cockpit2/engine/indicators/N1_percent", 2);
+ *  const int n1Pins[2] = { 9, 10 };
+ *  SimServoArray<2> n1Gauges(n1Pins, n1Ident, n1Map);
+ *  \endcode
+ */
+template <unsigned char N>
+class SimServoArray {
+public:
+  //! \param pins Servo signal pin for each element
+  //! \param idents Element identifiers, from SIM_DATAREF_ARRAY
+  //! Other parameters are as for SimServo.
+  template <size_t W, size_t P>
+  SimServoArray(const int    (&pins)[N],
+                const char   (&idents)[N][W],
+                const double (&map)[P][2],
+                const int restAngle = -1,
+                const bool *hasPowerFlag = &SimObject::hasPower)
+  {
+    SIM_STATIC_ASSERT(P >= 2, ScaleMap_needs_at_least_two_pairs);
+    SIM_STATIC_ASSERT(P <= SIM_SCALEMAP_PAIRS, ScaleMap_longer_than_SIM_SCALEMAP_PAIRS);
+    for (unsigned char i = 0; i < N; ++i) {
+      _servos[i]._pin = pins[i];
+      _servos[i].setPowerSource(hasPowerFlag);
+      _servos[i]._init(idents[i], map, P, restAngle,
+                       i == 0 ? 0 : &_servos[0]);
     }
   }
 
-  return true;
-}
+  SimServo &operator[](unsigned char i) { return _servos[i]; }
+
+private:
+  SimServo _servos[N];
+};
 
 
 
 //! Convert input to output via map, and write new servo-angle to servo
 void SimServo::_update(bool updateOutput) {
 
-  // assign dataref to stored 'input' value
-  _in = _dr;
-
-  // if input off map, put output on edge of map
-  if (_in <= _map[0][In]) {
-    _out = _map[0][Out];
-  }
-
-  if (_in >= _map[_mapPair-1][In]) {
-    _out = _map[_mapPair-1][Out];
-  }
-
-  // if input within map, interpolate output
-  for (int i = 1; i < _mapPair; ++i) {
-    if (_in < _map[i][In]) {
+  _dirty = false;
+  _lastPowered = _powered();
+  _lastEnabled = SimHAL::simEnabled();
 
-      double buf = _in;
-      buf -= _map[i-1][In];
-      buf /= _map[i][In] - _map[i-1][In];
-      buf *= _map[i][Out] - _map[i-1][Out];
-      buf += _map[i-1][Out];
-      _out = buf;
+  // if we have power, or don't need power
+  if(_lastPowered) {
+    // ask for the dataref on first power-up, and read it
+    SimDataRefs::subscribe(*_dr);
+    _in = *_dr;
 
-      // exit for loop
-      i = _mapPair;
-    }
-  }
+    // look up output, held as it leaves the map if input is off the map
+    _out = _scale->lookup(_in);
 
-  // if we have power, or don't need power
-  if(*_powerSource || !_needsPower) {
-    // convert double to int to give to RC servo
-    _servoAngle = (int)(_out + 0.5);
+    // round to the nearest degree for the RC servo
+    unsigned char shift = _scale->outShift();
+    _servoAngle = shift ? (_out + (1L << (shift - 1))) >> shift : _out;
   } else {
     // move to resting position if defined
     if (_restAngle > -1) {
@@ -223,7 +295,8 @@ void SimServo::_update(bool updateOutput) {
   }
 
   // use updateOutput as a final gate to write to servo
-  if (updateOutput && FlightSim.isEnabled()) {
+  _written = updateOutput && _lastEnabled;
+  if (_written) {
     _servo.write(_servoAngle);
   }
 
@@ -0,0 +1,122 @@
+
+// SimShiftOutput Development Version
+
+/*
+     * Copyright 2012 Jack Deeth
+     * Contact: simulationelectronics@gmail.com
+     *
+     * SimOutput for a chain of 74HC595 shift registers on the SPI bus,
+     * giving 8 LED outputs per register for three pins of the board.
+     * The sketch must also #include <SPI.h>.
+     *
+     * This program is free software: you can redistribute it and/or modify
+     * it under the terms of the GNU Lesser General Public License as
+     * published by the Free Software Foundation, either version 3 of the
+     * License, or (at your option) any later version.
+     *
+     * This program is distributed in the hope that it will be useful,
+     * but WITHOUT ANY WARRANTY; without even the implied warranty of
+     * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+     * GNU Lesser General Public License for more details.
+     *
+     * You should have received a copy of the GNU Lesser General Public
+     * License along with this program.
+     * If not, see <http://www.gnu.org/licenses/>.
+     *
+     * I would appreciate, but not insist, on attribution if this code is
+     * incorporated into other projects.
+     */
+
+#ifndef SIMSHIFTOUTPUTDEV_H
+#define SIMSHIFTOUTPUTDEV_H
+
+#include <SPI.h>
+#include "SimOutputDev.h"
+
+namespace SimHAL {
+
+//! Start the SPI bus
+inline void spiBegin(void) { SPI.begin(); }
+
+//! Send count bytes over SPI, MSB first, in one burst
+inline void spiWrite(const unsigned char *data, unsigned char count) {
+#ifdef SPI_HAS_TRANSACTION
+  SPI.beginTransaction(SPISettings(4000000, MSBFIRST, SPI_MODE0));
+#endif
+  for (unsigned char i = 0; i < count; ++i)
+    SPI.transfer(data[i]);
+#ifdef SPI_HAS_TRANSACTION
+  SPI.endTransaction();
+#endif
+}
+
+} // namespace SimHAL
+
+
+
+//! LEDs on a chain of N 74HC595 shift registers.
+/*! Wire the chain's data and clock inputs to the board's SPI MOSI and
+ *  SCK pins, and all the latch (RCLK) inputs to latchPin. Channel n is
+ *  output Qn%8 of register n/8, counting register 0 as the one nearest
+ *  the board. The whole chain is sent in one SPI burst, and only in
+ *  passes where an LED on it changed.
+ *  \code
+ *  SimShiftOutput<4> overheadLamps(10);    // 32 outputs, latch on pin 10
+ *  SimLEDIntDR fuelLow(overheadLamps.pin(0), fuelLowIdent);
+ *  \endcode
+ */
+template <unsigned char N>
+class SimShiftOutput : public SimOutput {
+public:
+  //! \param latchPin Arduino pin wired to the registers' latch inputs
+  SimShiftOutput(int latchPin) : _latchPin(latchPin), _changed(true) {
+    SIM_STATIC_ASSERT(N >= 1 && N <= (1 << SIM_OUTPUT_CHANNEL_BITS) / 8,
+                      SimShiftOutput_chain_length_out_of_range);
+    for (unsigned char i = 0; i < N; ++i)
+      _frame[i] = 0;
+  }
+
+  bool channel(unsigned int n, unsigned int &handle) {
+    handle = n;
+    return n < 8U * N;
+  }
+
+  void write(unsigned int handle, bool state) {
+    unsigned char &reg = _frame[N - 1 - (handle >> 3)];
+    unsigned char bits = state ? reg | (1 << (handle & 7))
+                               : reg & ~(1 << (handle & 7));
+    if (bits != reg) {
+      reg = bits;
+      _changed = true;
+    }
+  }
+
+private:
+  int _latchPin;
+
+  //! Register contents, in the order sent: furthest register first
+  unsigned char _frame[N];
+
+  //! True if _frame differs from what the registers hold
+  bool _changed;
+
+  void _setup(void) {
+    SimHAL::outputPin(_latchPin);
+    SimHAL::writePin(_latchPin, false);
+    SimHAL::spiBegin();
+    _changed = true;
+    _flush();
+  }
+
+  void _flush(void) {
+    if (!_changed)
+      return;
+    SimHAL::spiWrite(_frame, N);
+    SimHAL::writePin(_latchPin, true);
+    SimHAL::writePin(_latchPin, false);
+    _changed = false;
+  }
+};
+
+
+#endif // SIMSHIFTOUTPUTDEV_H
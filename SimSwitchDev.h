@@ -0,0 +1,401 @@
+
+// SimSwitch Development Version
+
+/*
+     * Copyright 2012 Jack Deeth
+     * Contact: simulationelectronics@gmail.com
+     *
+     * Panel switches and buttons on the board's own pins, read a port at
+     * a time and debounced together, driving datarefs, X-Plane commands
+     * or functions of the sketch.
+     *
+     * This program is free software: you can redistribute it and/or modify
+     * it under the terms of the GNU Lesser General Public License as
+     * published by the Free Software Foundation, either version 3 of the
+     * License, or (at your option) any later version.
+     *
+     * This program is distributed in the hope that it will be useful,
+     * but WITHOUT ANY WARRANTY; without even the implied warranty of
+     * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+     * GNU Lesser General Public License for more details.
+     *
+     * You should have received a copy of the GNU Lesser General Public
+     * License along with this program.
+     * If not, see <http://www.gnu.org/licenses/>.
+     *
+     * I would appreciate, but not insist, on attribution if this code is
+     * incorporated into other projects.
+     */
+
+#ifndef SIMSWITCHDEV_H
+#define SIMSWITCHDEV_H
+
+#include "SimObjectsDev.h"
+#include "SimDataRefDev.h"
+
+//! Most ports the pins of one SimSwitchBank can be spread over
+#ifndef SIM_SWITCH_PORTS
+#define SIM_SWITCH_PORTS 8
+#endif
+
+class SimSwitchInput;
+
+
+//! Switches on the board's own pins, debounced together.
+/*! Each update reads every port the switches are on once, and runs all
+ *  eight pins of a port through a vertical counter at the same time: a
+ *  switch changes state once it has read the same for four samples in
+ *  a row. The bank costs a few bytes per port, not per switch, so a
+ *  panel of 80 switches needs no Bounce objects at all.
+ *
+ *  Banks are read at the start of SimObject::update(), before anything
+ *  else, and are PriorityCritical. Their state can be read directly, or
+ *  SimSwitch and SimButton can act on their changes.
+ *  \code
+ *  DataRefIdent batteryIdent[] = "sim/cockpit/electrical/battery_on";
+ *  DataRefIdent apuStartIdent[] = "sim/electrical/APU_start";
+ *
+ *  const int ovhdPins[] = { 0, 1, 2, 3, 4, 5, 6, 7, 10, 11 };
+ *  SimSwitchBank ovhdSwitches(ovhdPins);
+ *  SimSwitch battery(ovhdSwitches, 0, batteryIdent);
+ *  SimButton apuStart(ovhdSwitches, 9, apuStartIdent);
+ *  \endcode
+ */
+class SimSwitchBank : public SimObject {
+public:
+  //! \param pins Arduino pin of each switch. Switch n is pins[n].
+  //! \param activeLow True (the default) for switches closing to
+  //!        ground, using the pins' pull-up resistors. False for
+  //!        switches closing to the supply, with pull-down resistors.
+  //! \param sampleInterval Milliseconds between samples, so switches
+  //!        are debounced over four times this
+  template <size_t N>
+  SimSwitchBank(const int (&pins)[N],
+                bool activeLow = true,
+                unsigned int sampleInterval = 2) :
+    SimObject(0),
+    _pins(pins),
+    _count(N),
+    _activeLow(activeLow),
+    _portCount(0),
+    _lastEnabled(false),
+    _first(0)
+  {
+    SIM_STATIC_ASSERT(N >= 1 && N <= 255, SimSwitchBank_size_out_of_range);
+    setInterval(sampleInterval);
+    setPriority(PriorityCritical);
+    _addToGroup(_typeGroup);
+  }
+
+  //! True while switch n is closed, after debouncing
+  bool read(unsigned char n) const {
+    unsigned char p, mask;
+    return _find(n, p, mask) && _closed(p, mask);
+  }
+
+  //! True if switch n closed in the last update
+  bool pressed(unsigned char n) const {
+    unsigned char p, mask;
+    return _find(n, p, mask) && (_toggled[p] & mask) && _closed(p, mask);
+  }
+
+  //! True if switch n opened in the last update
+  bool released(unsigned char n) const {
+    unsigned char p, mask;
+    return _find(n, p, mask) && (_toggled[p] & mask) && !_closed(p, mask);
+  }
+
+private:
+  const int *_pins;
+  unsigned char _count;
+  bool _activeLow;
+
+  //! Ports read, and the switch pins on each
+  unsigned char _portCount;
+  unsigned char _port[SIM_SWITCH_PORTS];
+  unsigned char _mask[SIM_SWITCH_PORTS];
+
+  //! Debounced pin levels, per port
+  unsigned char _state[SIM_SWITCH_PORTS];
+
+  //! Two-bit vertical counters: samples each pin has differed from
+  //! _state, counting 1, 2, 3 then changing state on the fourth
+  unsigned char _count0[SIM_SWITCH_PORTS];
+  unsigned char _count1[SIM_SWITCH_PORTS];
+
+  //! Pins which changed state in the last update
+  unsigned char _toggled[SIM_SWITCH_PORTS];
+
+  //! X-Plane link state at the last update, to resend switch positions
+  //! when it connects
+  bool _lastEnabled;
+
+  //! SimSwitches and SimButtons on this bank
+  SimSwitchInput *_first;
+  friend class SimSwitchInput;
+
+  //! Port index and pin mask of switch n. False if it is not read.
+  bool _find(unsigned char n, unsigned char &p, unsigned char &mask) const {
+    unsigned char port;
+    if (n >= _count || !SimHAL::pinPort(_pins[n], port, mask))
+      return false;
+    for (p = 0; p < _portCount; ++p) {
+      if (_port[p] == port)
+        return (_mask[p] & mask) != 0;
+    }
+    return false;
+  }
+
+  bool _closed(unsigned char p, unsigned char mask) const {
+    return ((_state[p] & mask) != 0) != _activeLow;
+  }
+
+  void _setup(void);
+  void _update(bool updateOutput = true);
+
+  friend class SimObject;
+  static SimGroup _typeGroup;
+  void _updateDirect(bool updateOutput) { SimSwitchBank::_update(updateOutput); }
+};
+
+// read before everything else
+SimGroup SimSwitchBank::_typeGroup = SIM_GROUP(SimSwitchBank, SimObject::LevelSwitch);
+
+
+
+//! One switch of a SimSwitchBank, acting when it changes
+class SimSwitchInput {
+public:
+  virtual ~SimSwitchInput() {
+    for (SimSwitchInput **link = &_bank->_first; *link != 0;
+         link = &(*link)->_nextInput) {
+      if (*link == this) {
+        *link = _nextInput;
+        break;
+      }
+    }
+  }
+
+protected:
+  SimSwitchInput(SimSwitchBank &bank, unsigned char n) :
+    _bank(&bank), _n(n), _p(0), _mask(0), _nextInput(0)
+  {
+    SimSwitchInput **link = &bank._first;
+    while (*link != 0)
+      link = &(*link)->_nextInput;
+    *link = this;
+  }
+
+  //! The switch has closed (true) or opened
+  virtual void _changed(bool closed) =0;
+
+  //! X-Plane has connected; closed is the switch's position
+  virtual void _sync(bool /*closed*/) {}
+
+  //! Called from the bank's setup
+  virtual void _setup(void) {}
+
+private:
+  // linked into the bank by address
+  SimSwitchInput(const SimSwitchInput &);
+  SimSwitchInput & operator = (const SimSwitchInput &);
+
+  SimSwitchBank *_bank;
+  unsigned char _n;
+
+  //! Port index and pin mask in the bank, found by the bank's setup
+  unsigned char _p;
+  unsigned char _mask;
+
+  SimSwitchInput *_nextInput;
+  friend class SimSwitchBank;
+};
+
+
+
+//! A switch setting a dataref, or calling a function, as it moves.
+/*! The position is also sent whenever X-Plane connects, so the
+ *  simulator matches the panel.
+ *  \code
+ *  DataRefIdent batteryIdent[] = "sim/cockpit/electrical/battery_on";
+ *  SimSwitch battery(ovhdSwitches, 0, batteryIdent);
+ *
+ *  void recallHeld(bool closed) { masterCaution.setRecall(closed); }
+ *  SimSwitch recall(glareshield, 1, recallHeld);
+ *  \endcode
+ */
+class SimSwitch : public SimSwitchInput {
+public:
+  //! Write onValue to the integer dataref ident while switch n of bank
+  //! is closed, and offValue while it is open. ident is a DataRefIdent,
+  //! or from SIM_DATAREF_TABLE, in program memory.
+  SimSwitch(SimSwitchBank &bank, unsigned char n, const char *ident,
+            int onValue = 1, int offValue = 0) :
+    SimSwitchInput(bank, n),
+    _dr(&SimDataRefs::intRef(ident)),
+    _onChange(0),
+    _onValue(onValue),
+    _offValue(offValue)
+  {}
+
+  //! Call onChange(closed) when switch n of bank moves
+  SimSwitch(SimSwitchBank &bank, unsigned char n,
+            void (*onChange)(bool closed)) :
+    SimSwitchInput(bank, n),
+    _dr(0),
+    _onChange(onChange),
+    _onValue(1),
+    _offValue(0)
+  {}
+
+private:
+  FlightSimInteger *_dr;
+  void (*_onChange)(bool closed);
+  int _onValue;
+  int _offValue;
+
+  void _setup(void) {
+    if (_dr != 0)
+      SimDataRefs::subscribe(*_dr);
+  }
+
+  void _changed(bool closed) {
+    if (_dr != 0)
+      _dr->write(closed ? _onValue : _offValue);
+    if (_onChange != 0)
+      _onChange(closed);
+  }
+
+  void _sync(bool closed) { _changed(closed); }
+};
+
+
+
+//! A push-button holding an X-Plane command, or calling functions.
+/*! \code
+ *  DataRefIdent apuStartIdent[] = "sim/electrical/APU_start";
+ *  SimButton apuStart(ovhdSwitches, 9, apuStartIdent);
+ *
+ *  void resetCaution(void) { masterCaution.reset(); }
+ *  SimButton reset(glareshield, 0, resetCaution);
+ *  \endcode
+ */
+class SimButton : public SimSwitchInput {
+public:
+  //! Hold the command ident for as long as button n of bank is pressed.
+  //! ident is a DataRefIdent, or from SIM_DATAREF_TABLE, in program
+  //! memory.
+  SimButton(SimSwitchBank &bank, unsigned char n, const char *ident) :
+    SimSwitchInput(bank, n),
+    _ident(ident),
+    _onPress(0),
+    _onRelease(0)
+  {}
+
+  //! Call onPress when button n of bank is pressed, and onRelease, if
+  //! given, when it is let go
+  SimButton(SimSwitchBank &bank, unsigned char n,
+            void (*onPress)(void), void (*onRelease)(void) = 0) :
+    SimSwitchInput(bank, n),
+    _ident(0),
+    _onPress(onPress),
+    _onRelease(onRelease)
+  {}
+
+private:
+  const char *_ident;
+  FlightSimCommand _command;
+  void (*_onPress)(void);
+  void (*_onRelease)(void);
+
+  void _setup(void) {
+    if (_ident != 0)
+      _command.assign((const _XpRefStr_ *) _ident);
+  }
+
+  void _changed(bool pressed) {
+    if (pressed) {
+      if (_ident != 0)
+        _command.begin();
+      if (_onPress != 0)
+        _onPress();
+    } else {
+      if (_ident != 0)
+        _command.end();
+      if (_onRelease != 0)
+        _onRelease();
+    }
+  }
+};
+
+
+
+void SimSwitchBank::_setup(void) {
+  // gather the pins by port
+  _portCount = 0;
+  for (unsigned char n = 0; n < _count; ++n) {
+    unsigned char port, mask, p;
+    if (!SimHAL::pinPort(_pins[n], port, mask))
+      continue;
+    for (p = 0; p < _portCount && _port[p] != port; ++p)
+      ;
+    if (p == _portCount) {
+      // pins on ports beyond SIM_SWITCH_PORTS are not read
+      if (_portCount == SIM_SWITCH_PORTS)
+        continue;
+      _port[p] = port;
+      _mask[p] = 0;
+      ++_portCount;
+    }
+    _mask[p] |= mask;
+  }
+
+  // start from the switches' present positions
+  for (unsigned char p = 0; p < _portCount; ++p) {
+    SimHAL::inputPortBits(_port[p], _mask[p], _activeLow);
+    _state[p] = SimHAL::readPortBits(_port[p]) & _mask[p];
+    _count0[p] = _count1[p] = _toggled[p] = 0;
+  }
+  _lastEnabled = false;
+
+  for (SimSwitchInput *in = _first; in != 0; in = in->_nextInput) {
+    if (!_find(in->_n, in->_p, in->_mask))
+      in->_mask = 0;
+    in->_setup();
+  }
+}
+
+
+void SimSwitchBank::_update(bool /*updateOutput*/) {
+  unsigned char changed = 0;
+  for (unsigned char p = 0; p < _portCount; ++p) {
+    unsigned char delta = (SimHAL::readPortBits(_port[p]) & _mask[p])
+                        ^ _state[p];
+    // count pins differing from their state, and restart pins which
+    // bounced back
+    _count1[p] = (_count1[p] ^ _count0[p]) & delta;
+    _count0[p] = ~_count0[p] & delta;
+    unsigned char toggle = delta & ~(_count0[p] | _count1[p]);
+    _state[p] ^= toggle;
+    _toggled[p] = toggle;
+    changed |= toggle;
+  }
+
+  bool enabled = SimHAL::simEnabled();
+  bool sync = enabled && !_lastEnabled;
+  _lastEnabled = enabled;
+  if (!changed && !sync)
+    return;
+
+  for (SimSwitchInput *in = _first; in != 0; in = in->_nextInput) {
+    if (in->_mask == 0)
+      continue;
+    if (_toggled[in->_p] & in->_mask)
+      in->_changed(_closed(in->_p, in->_mask));
+    else if (sync)
+      in->_sync(_closed(in->_p, in->_mask));
+  }
+}
+
+
+#endif // SIMSWITCHDEV_H
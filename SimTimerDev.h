@@ -0,0 +1,150 @@
+
+// SimTimer Development Version
+
+/*
+     * Copyright 2012 Jack Deeth
+     * Contact: simulationelectronics@gmail.com
+     *
+     * Periodic hardware timer interrupt, for SimObjects work which must
+     * happen at a steady rate whatever the main loop is doing.
+     *
+     * Uses IntervalTimer on ARM Teensys and Timer3 on AVR boards which
+     * have one (Teensy 2.0, Teensy++ 2.0, Leonardo, Mega). On the host
+     * the interrupt runs as SimHost::advanceMicros() moves the fake clock.
+     *
+     * The timer is only claimed if SIM_USE_TIMER is defined before any
+     * SimObjects header is included, or if SimMatrixOutputDev.h is the
+     * first of them, so sketches using tone(), TimerThree or their own
+     * IntervalTimer keep it. Without it timerBegin() returns false.
+     *
+     * This program is free software: you can redistribute it and/or modify
+     * it under the terms of the GNU Lesser General Public License as
+     * published by the Free Software Foundation, either version 3 of the
+     * License, or (at your option) any later version.
+     *
+     * This program is distributed in the hope that it will be useful,
+     * but WITHOUT ANY WARRANTY; without even the implied warranty of
+     * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+     * GNU Lesser General Public License for more details.
+     *
+     * You should have received a copy of the GNU Lesser General Public
+     * License along with this program.
+     * If not, see <http://www.gnu.org/licenses/>.
+     *
+     * I would appreciate, but not insist, on attribution if this code is
+     * incorporated into other projects.
+     */
+
+#ifndef SIMTIMERDEV_H
+#define SIMTIMERDEV_H
+
+#include "SimHALDev.h"
+
+#if !defined(SIM_USE_TIMER)
+// the timer is left to the sketch
+#elif defined(SIMOBJECTS_HOST)
+#define SIMHAL_TIMER_HOST
+#elif defined(__arm__) && defined(CORE_TEENSY)
+#define SIMHAL_TIMER_INTERVALTIMER
+#elif defined(__AVR__) && defined(TCCR3A)
+#define SIMHAL_TIMER_AVR_TIMER3
+#endif
+
+namespace SimHAL {
+
+#if defined(SIMHAL_TIMER_INTERVALTIMER)
+IntervalTimer simTimer;
+#elif defined(SIMHAL_TIMER_AVR_TIMER3)
+void (*simTimerIsr)(void) = 0;
+#endif
+
+//! Call isr every period microseconds from a timer interrupt.
+/*! There is one such timer; starting it again replaces the handler.
+ *  Returns false if the board has no timer SimObjects can use, if
+ *  SIM_USE_TIMER is not defined, or if the period is out of its range.*/
+inline bool timerBegin(void (*isr)(void), unsigned long period) {
+#if defined(SIMHAL_TIMER_HOST)
+  if (!SimHost::timerPresent || period == 0)
+    return false;
+  SimHost::timerIsr = isr;
+  SimHost::timerPeriod = period;
+  SimHost::timerDue = micros() + period;
+  return true;
+#elif defined(SIMHAL_TIMER_INTERVALTIMER)
+  return simTimer.begin(isr, period);
+#elif defined(SIMHAL_TIMER_AVR_TIMER3)
+  // CTC mode, with the smallest prescaler that fits the period
+  unsigned long ticks = period * (F_CPU / 1000000UL);
+  unsigned char prescale = _BV(CS30);
+  if (ticks > 65536UL) {
+    ticks /= 8;
+    prescale = _BV(CS31);
+  }
+  if (ticks > 65536UL) {
+    ticks /= 8;
+    prescale = _BV(CS31) | _BV(CS30);
+  }
+  if (ticks > 65536UL || ticks == 0)
+    return false;
+  uint8_t oldSREG = SREG;
+  cli();
+  simTimerIsr = isr;
+  TCCR3A = 0;
+  TCCR3B = _BV(WGM32) | prescale;
+  TCNT3 = 0;
+  OCR3A = ticks - 1;
+  TIMSK3 |= _BV(OCIE3A);
+  SREG = oldSREG;
+  return true;
+#else
+  (void)isr;
+  (void)period;
+  return false;
+#endif
+}
+
+//! Stop the timer interrupt
+inline void timerEnd(void) {
+#if defined(SIMHAL_TIMER_HOST)
+  SimHost::timerIsr = 0;
+#elif defined(SIMHAL_TIMER_INTERVALTIMER)
+  simTimer.end();
+#elif defined(SIMHAL_TIMER_AVR_TIMER3)
+  TIMSK3 &= ~_BV(OCIE3A);
+  TCCR3B = 0;
+  simTimerIsr = 0;
+#endif
+}
+
+//! Hold off the timer interrupt, e.g. while handing it new data.
+/*! A tick falling due meanwhile runs at timerRelease(). Keep it short.*/
+inline void timerHold(void) {
+#if defined(SIMHAL_TIMER_INTERVALTIMER)
+  noInterrupts();
+#elif defined(SIMHAL_TIMER_AVR_TIMER3)
+  TIMSK3 &= ~_BV(OCIE3A);
+#endif
+}
+
+//! Let the timer interrupt run again after timerHold()
+inline void timerRelease(void) {
+#if defined(SIMHAL_TIMER_INTERVALTIMER)
+  interrupts();
+#elif defined(SIMHAL_TIMER_AVR_TIMER3)
+  if (simTimerIsr != 0)
+    TIMSK3 |= _BV(OCIE3A);
+#endif
+}
+
+} // namespace SimHAL
+
+
+#if defined(SIMHAL_TIMER_AVR_TIMER3)
+ISR(TIMER3_COMPA_vect) {
+  if (SimHAL::simTimerIsr != 0)
+    SimHAL::simTimerIsr();
+}
+#endif
+
+
+#endif // SIMTIMERDEV_H
@@ -37,9 +37,24 @@
 #include "SimObjectsDev.h"
 #include "SimLEDDev.h"
 
+//! Most sub-annunciators feeding one SystemAnnc, at most 255. Define
+//! before including SystemAnnc.h to change it.
+#ifndef SIM_MAX_ANNCS_PER_SA
+#define SIM_MAX_ANNCS_PER_SA 32
+#endif
+
+//! Most SystemAnncs feeding one MasterCaution, at most 255
+#ifndef SIM_MAX_SA_PER_MC
+#define SIM_MAX_SA_PER_MC 32
+#endif
+
+// counts and slots are kept in unsigned chars
+SIM_STATIC_ASSERT(SIM_MAX_ANNCS_PER_SA <= 255 && SIM_MAX_SA_PER_MC <= 255,
+                  SystemAnnc_fan_in_limits_too_large);
+
 namespace b737 {
-const int MAX_ANNCS_PER_SA = 12;
-const int MAX_SA_PER_MC = 12;
+const int MAX_ANNCS_PER_SA = SIM_MAX_ANNCS_PER_SA;
+const int MAX_SA_PER_MC = SIM_MAX_SA_PER_MC;
 
 //! System Annunciator class for Boeing 737
 /*! Works in conjunction with the MasterCaution class.
@@ -51,29 +66,26 @@ public:
   /*! \param ledPin Arduino pin number of this SysAnnc's LED. Set to -1
    *         if not automatically outputting to an LED. (LED output can
    *         still be done using the .isLit() member function.)
-   *  \param subAnncList list of SimLEDs (dataref-fed or local-logic-fed)
+   *  \param subAnncList array of SimLEDs (dataref-fed or local-logic-fed)
    *         which belong to this system and feed this System Annunciator
    *         They do not need to be linked to real LEDS (they can have a
-   *         pin number of -1)
-   *  \param sizeof_subAnncList This MUST be specified using sizeof(
-   *         subAnncList) when the constructor is called!
+   *         pin number of -1). Its size is taken from its declaration,
+   *         and a list longer than MAX_ANNCS_PER_SA is a compile error.
    *  \param enableTest Should this SystemAnnc participate in generic
    *         SimLED bulb tests. Default is 'no' as the bulb test is
    *         provided by MasterCaution.recallMode(true).
    *  \param hasPowerFlag pointer to bool acting as simulated power
    *         supply for this SystemAnnc
    */
+  template <size_t N>
   SystemAnnc (const int    &ledPin,
-         SimLEDBase   *subAnncList[],
-         const size_t sizeof_subAnncList,
-         const bool   &enableTest   = false,
-         const bool   *hasPowerFlag = &SimObject::hasPower )
-    : SimLEDBase(ledPin, enableTest, hasPowerFlag)
+              SimLEDBase   * const (&subAnncList)[N],
+              const bool   &enableTest   = false,
+              const bool   *hasPowerFlag = &SimObject::hasPower )
+    : SimLEDBase(ledPin, enableTest, hasPowerFlag, _typeGroup)
   {
-    _subAnncs = subAnncList;
-    _subAnncCount = sizeof_subAnncList / (sizeof(SimLEDBase*));
-    if(_subAnncCount > MAX_ANNCS_PER_SA)
-      _subAnncCount = MAX_ANNCS_PER_SA;
+    SIM_STATIC_ASSERT(N <= MAX_ANNCS_PER_SA, too_many_subAnncs_for_SystemAnnc);
+    _init(subAnncList, N);
   }
 
   // needed so MasterCaution can call our _reset function
@@ -81,13 +93,19 @@ public:
 
 private:
   //! Pointer to array of SimLED sub-annunciators
-  SimLEDBase **_subAnncs;
+  SimLEDBase * const *_subAnncs;
 
   //! Number of sub-annunciators feeding this SysAnnc
-  unsigned short _subAnncCount;
+  unsigned char _subAnncCount;
+
+  //! Which subAnncs are active, kept by _inputChangedAt()
+  SimBits<MAX_ANNCS_PER_SA> _subActive;
+
+  //! Number of subAnncs set in _subActive
+  unsigned char _activeCount;
 
   //! Record of which active subAnncs have been acknowledged as active
-  bool _subAck[MAX_ANNCS_PER_SA];
+  SimBits<MAX_ANNCS_PER_SA> _subAck;
 
   //! Recall mode lights the output regardless of subannc state
   bool _recallMode;
@@ -95,48 +113,95 @@ private:
   //! True if any subanncs are active, regardless of ack'd status
   bool _hasActive;
 
-  void _updateActive() {
+  //! Each subAnnc tells us when it changes, so none are read here
+  void _inputChangedAt(unsigned char slot, bool active) {
+    if (active == _subActive.test(slot))
+      return;
+    if (active) {
+      _subActive.set(slot);
+      ++_activeCount;
+    } else {
+      _subActive.reset(slot);
+      --_activeCount;
+    }
+  }
+
+  //! Called directly by _updateDirect(), so not for overriding
+  void _updateActive() SIM_FINAL {
+    // subAnncs which tell another listener have to be read
+    if (_pollInputs) {
+      for (unsigned char i = 0; i < _subAnncCount; ++i)
+        _inputChangedAt(i, _subAnncs[i]->isActive());
+    }
     if (_recallMode) {
       _active = true;
       return;
     }
-    _hasActive = false;
-    for (int i = 0; i < _subAnncCount; ++i) {
-      if(_subAnncs[i]->isActive()) {
-        _hasActive = true;
-        if(!_subAck[i]) {
-          _active = true;
-          _subAck[i] = true;
-        }
-      } else {
-        _subAck[i] = false;
-      }
-    }
+    // newly active subAnncs light us; all active ones are then ack'd
+    if (_subActive.anyNotIn(_subAck))
+      _active = true;
+    _hasActive = (_activeCount != 0);
+    _subAck = _subActive;
   } //_updateActive
 
+  void _init(SimLEDBase * const subAnncList[], size_t count) {
+    _subAnncs = subAnncList;
+    _subAnncCount = count;
+    _subActive.clear();
+    _activeCount = 0;
+    _subAck.clear();
+    _recallMode = false;
+    _hasActive = false;
+    _active = false;
+  }
+
+  SimObject *_input(unsigned int i) {
+    return i < _subAnncCount ? _subAnncs[i] : 0;
+  }
+
   //! Deactivates subAnnc. Called by MasterCaution.
-  void _reset() { _active = false; }
+  void _reset() {
+    _active = false;
+    _inputChanged = true;   // recall mode relights at once
+  }
 
   //! Set recall mode on/off
   void _setRecall(bool mode) {
     // if we are starting recall mode
     if (mode && !_recallMode) {
       _recallMode = true;
+      _inputChanged = true;
     }
 
     // if we are ending Recall mode
     if (!mode && _recallMode) {
       // clear all acknowledgements
-      for (int i = 0; i < _subAnncCount; ++i) {
-        _subAck[i] = false;
-      }
+      _subAck.clear();
       _recallMode = false;
       _active = false;
+      _inputChanged = true;
     }
   }
 
+  friend class ::SimObject;
+  static SimGroup _typeGroup;
+  void _updateDirect(bool updateOutput) {
+    if (_needsEvaluation()) {
+      _inputChanged = false;
+      bool hadActive = _hasActive;
+      SystemAnnc::_updateActive();
+      // MasterCaution follows _hasActive rather than _active
+      if (_hasActive != hadActive)
+        _notifyListener();
+    }
+    _updateLit(updateOutput);
+  }
+
 };
 
+// SystemAnncs are updated after their sub-annunciators
+SimGroup SystemAnnc::_typeGroup = SIM_GROUP(SystemAnnc, SimObject::LevelLogic);
+
 
 
 
@@ -145,7 +210,8 @@ private:
 
 
 //! Master Caution class for Boeing 737
-/*! Works in conjunction with SystemAnnc
+/*! Works in conjunction with SystemAnnc. PriorityCritical by default, so
+ *  it is updated every pass even when SimObject::setBudget() is in use.
  */
 class MasterCaution : public SimLEDBase {
 public:
@@ -153,27 +219,25 @@ public:
   /*! \param ledPin Arduino pin number for LED. Set to -1
    *         if not automatically outputting to an LED. (LED output can
    *         still be done using the .isLit() member function.)
-   *  \param sysAnncList list of SystemAnncs which feed this Master
+   *  \param sysAnncList array of SystemAnncs which feed this Master
    *         Caution light. They do not need to be linked to real LEDS
-   *         (they can have a pin number of -1)
-   *  \param sizeof_sysAnncList This MUST be specified using sizeof(
-   *         sysAnncList) when the constructor is called!
+   *         (they can have a pin number of -1). Its size is taken from
+   *         its declaration, and a list longer than MAX_SA_PER_MC is a
+   *         compile error.
    *  \param enableTest Sets participation in generic
    *         SimLED bulb tests. Defaults to 'true'.
    *  \param hasPowerFlag pointer to bool acting as simulated power
    *         supply
    */
+  template <size_t N>
   MasterCaution (const int    &ledPin,
-         SystemAnnc *sysAnncList[],
-         const size_t sizeof_sysAnncList,
-         const bool   &enableTest   = true,
-         const bool   *hasPowerFlag = &SimObject::hasPower )
-    : SimLEDBase(ledPin, enableTest, hasPowerFlag)
+                 SystemAnnc   * const (&sysAnncList)[N],
+                 const bool   &enableTest   = true,
+                 const bool   *hasPowerFlag = &SimObject::hasPower )
+    : SimLEDBase(ledPin, enableTest, hasPowerFlag, _typeGroup)
   {
-    _sysAnncs = sysAnncList;
-    _sysAnncCount = sizeof_sysAnncList / (sizeof(SystemAnnc*));
-    if(_sysAnncCount > MAX_SA_PER_MC)
-      _sysAnncCount = MAX_SA_PER_MC;
+    SIM_STATIC_ASSERT(N <= MAX_SA_PER_MC, too_many_SystemAnncs_for_MasterCaution);
+    _init(sysAnncList, N);
   }
 
   //! Reset all System Annunciators linked with this object
@@ -182,6 +246,8 @@ public:
       _sysAnncs[i]->_reset();
     }
     _active = false;
+    // re-lights next pass if any system still has an active annunciator
+    _inputChanged = true;
   }
 
   //! Set Recall mode for all System Annunciators linked with this object
@@ -194,23 +260,73 @@ public:
 
 private:
   //! Pointer to array of SystemAnnc associated with this MasterCaution
-  SystemAnnc **_sysAnncs;
+  SystemAnnc * const *_sysAnncs;
 
   //! Number of SystemAnnc linked to this MasterCaution
-  unsigned short _sysAnncCount;
+  unsigned char _sysAnncCount;
 
-  //! MasterCaution is active if any of the fault lights are on
-  void _updateActive() {
-    for (int i = 0; i < _sysAnncCount; ++i) {
-      if(_sysAnncs[i]->_hasActive) {
-        _active = true;
-      }
+  //! Which SystemAnncs have an active subAnnc, kept by _inputChangedAt()
+  SimBits<MAX_SA_PER_MC> _sysActive;
+
+  //! Number of SystemAnncs set in _sysActive
+  unsigned char _activeCount;
+
+  void _init(SystemAnnc * const sysAnncList[], size_t count) {
+    _sysAnncs = sysAnncList;
+    _sysAnncCount = count;
+    _sysActive.clear();
+    _activeCount = 0;
+    _active = false;
+    // the pilot's attention-getter, so never held back by the budget
+    setPriority(PriorityCritical);
+  }
+
+  SimObject *_input(unsigned int i) {
+    return i < _sysAnncCount ? _sysAnncs[i] : 0;
+  }
+
+  //! A SystemAnnc tells us when its _active or _hasActive changes. We
+  //! follow _hasActive, so read that rather than the state passed.
+  void _inputChangedAt(unsigned char slot, bool /*active*/) {
+    bool active = _sysAnncs[slot]->_hasActive;
+    if (active == _sysActive.test(slot))
+      return;
+    if (active) {
+      _sysActive.set(slot);
+      ++_activeCount;
+    } else {
+      _sysActive.reset(slot);
+      --_activeCount;
     }
+  }
+
+  //! MasterCaution is active if any of the fault lights are on. Called
+  //! directly by _updateDirect(), so not for overriding.
+  void _updateActive() SIM_FINAL {
+    // SystemAnncs which tell another listener have to be read
+    if (_pollInputs) {
+      for (unsigned char i = 0; i < _sysAnncCount; ++i)
+        _inputChangedAt(i, false);
+    }
+    if (_activeCount != 0)
+      _active = true;
   } //_updateActive
 
+  friend class ::SimObject;
+  static SimGroup _typeGroup;
+  void _updateDirect(bool updateOutput) {
+    if (_needsEvaluation()) {
+      _inputChanged = false;
+      MasterCaution::_updateActive();
+    }
+    _updateLit(updateOutput);
+  }
 
 };
 
+// MasterCautions are updated after their SystemAnncs
+SimGroup MasterCaution::_typeGroup = SIM_GROUP(MasterCaution, SimObject::LevelMaster);
+
 } //namespace b737SysAnnc
 
 #endif // SYSTEMANNC_H
@@ -41,48 +41,77 @@
 ///////////////////////////////////////////////////////////////////////////////
 */
 
-#include <Bounce.h>
+// exactly the datarefs this panel uses, so no RAM is wasted on spares
+#define SIM_DATAREF_INTS 12
+#define SIM_DATAREF_FLOATS 2
+
 #include <SimObjectsDev.h>
 #include <SimLEDDev.h>
 #include <SystemAnnc.h>
+#include <SimSwitchDev.h>
 
 
 
 /////// Overhead panel fault lights
 
+// Every SimObject below is a global object, and the lists feeding the
+// System Annunciators are constant arrays of their addresses, so the
+// whole panel is laid out at compile time with no use of the heap.
+// The SystemAnnc and MasterCaution constructors take the arrays
+// directly, so an over-long list is a compile error.
+
+
+
+//// Dataref identifiers
+
+// All the panel's identifiers, packed into one table in flash with no
+// padding. Each is reached by name, e.g. ovhdRefs.lowVolts.
+#define ANNC "sim/cockpit2/annunciators/"
+
+#define OVHD_REFS(X) \
+  X(yawDamper,   "sim/cockpit/switches/yaw_damper_on") \
+  X(trimFail,    ANNC "autopilot_trim_fail") \
+  X(elevTrim,    "sim/cockpit2/controls/elevator_trim") \
+  X(dcVoltSel,   "sim/cockpit2/electrical/dc_voltmeter_selection") \
+  X(parkBrake,   "sim/cockpit2/controls/parking_brake_ratio") \
+  X(lowVolts,    ANNC "low_voltage") \
+  X(invOff0,     ANNC "inverter_off[0]") \
+  X(apuGenOn,    "sim/cockpit2/electrical/APU_generator_on") \
+  X(apuPressure, "sim/operation/failures/rel_APU_press") \
+  X(hvac,        ANNC "hvac")
+
+SIM_DATAREF_TABLE(ovhdRefs, OVHD_REFS);
+
+// Per-engine array datarefs: "...oil_pressure_low[0]" and "...[1]"
+SIM_DATAREF_ARRAY(oilPressIdent, ANNC "oil_pressure_low", 2);
+SIM_DATAREF_ARRAY(genOffIdent, ANNC "generator_off", 2);
+
+// the sub-annunciators have no LEDs of their own
+const int noPins[2] = { -1, -1 };
+
 
 
 //// Flight system fault lights
 
-// list of dataref identifiers
-DataRefIdent fltIdent[][64] =  {
-  "sim/cockpit/switches/yaw_damper_on",
-  "sim/cockpit2/annunciators/autopilot_trim_fail",
-  "sim/cockpit2/controls/elevator_trim"
-};
+SimLEDIntDR   fltYawDamper(-1, ovhdRefs.yawDamper, true); // fault if yaw damper off
+SimLEDIntDR   fltTrimFail (-1, ovhdRefs.trimFail);        // fault if trim fails
+SimLEDFloatDR fltElevTrim (-1, ovhdRefs.elevTrim, -0.45, 0.45, true);
 
-// list of SimLEDs using those identifiers
-SimLEDBase * fltAnncs[] = {
-  new SimLEDIntDR(-1, fltIdent[0], true), // fault if yaw damper off
-  new SimLEDIntDR(-1, fltIdent[1]), // fault if trim fails
-  new SimLEDFloatDR(-1, fltIdent[2], -0.45, 0.45, true)
+// list of SimLEDs feeding the flight system annunciator
+SimLEDBase * const fltAnncs[] = {
+  &fltYawDamper,
+  &fltTrimFail,
+  &fltElevTrim
 };
 
 
 
 //// IRS system fault lights
 
-// alternative method of creating SimLEDs
-// as long as we end up with an array of pointers to our SimLEDs,
-// all is good.
-
-DataRefIdent irsIdent1[] = "sim/cockpit2/electrical/dc_voltmeter_selection";
-SimLEDIntDR irsAnnc1(-1, irsIdent1);
-
-DataRefIdent irsIdent2[] = "sim/cockpit2/controls/parking_brake_ratio";
-SimLEDFloatDR irsAnnc2(-1, irsIdent2, 0.6, 1.0);
+SimLEDIntDR irsAnnc1(-1, ovhdRefs.dcVoltSel);
+SimLEDFloatDR irsAnnc2(-1, ovhdRefs.parkBrake, 0.6, 1.0);
 
-SimLEDBase * irsAnncs[] = {
+SimLEDBase * const irsAnncs[] = {
   &irsAnnc1,
   &irsAnnc2
 };
@@ -91,114 +120,110 @@ SimLEDBase * irsAnncs[] = {
 
 //// Fuel system fault lights
 
-DataRefIdent fuelIdent[][64] =  {
-  "sim/cockpit2/annunciators/oil_pressure_low[0]",
-  "sim/cockpit2/annunciators/oil_pressure_low[1]"
-};
+SimLEDIntArrayDR<2> fuelOilPress(noPins, oilPressIdent);
 
-SimLEDBase * fuelAnncs[] = {
-  new SimLEDIntDR(-1, fuelIdent[0]),
-  new SimLEDIntDR(-1, fuelIdent[1])
+SimLEDBase * const fuelAnncs[] = {
+  &fuelOilPress[0],
+  &fuelOilPress[1]
 };
 
 
 
 //// Electrical system fault lights
 
-DataRefIdent elecIdent[][64] =  {
-  "sim/cockpit2/annunciators/low_voltage",
-  "sim/cockpit2/annunciators/generator_off[0]",
-  "sim/cockpit2/annunciators/generator_off[1]",
-  "sim/cockpit2/annunciators/inverter_off[0]"
-};
+SimLEDIntDR elecLowVolts(-1, ovhdRefs.lowVolts);
+SimLEDIntArrayDR<2> elecGenOff(noPins, genOffIdent);
+SimLEDIntDR elecInvOff  (-1, ovhdRefs.invOff0);
 
-SimLEDBase * elecAnncs[] = {
-  new SimLEDIntDR(-1, elecIdent[0]),
-  new SimLEDIntDR(-1, elecIdent[1]),
-  new SimLEDIntDR(-1, elecIdent[2]),
-  new SimLEDIntDR(-1, elecIdent[3])
+SimLEDBase * const elecAnncs[] = {
+  &elecLowVolts,
+  &elecGenOff[0],
+  &elecGenOff[1],
+  &elecInvOff
 };
 
 
 
 //// APU fault lights
 
-DataRefIdent apuIdent[][64] =  {
-  "sim/cockpit2/electrical/APU_generator_on",
-  "sim/operation/failures/rel_APU_press"
-};
+SimLEDIntDR apuGenOn   (-1, ovhdRefs.apuGenOn);
+SimLEDIntDR apuPressure(-1, ovhdRefs.apuPressure);
 
-SimLEDBase * apuAnncs[] = {
-  new SimLEDIntDR(-1, apuIdent[0]),
-  new SimLEDIntDR(-1, apuIdent[1])
+SimLEDBase * const apuAnncs[] = {
+  &apuGenOn,
+  &apuPressure
 };
 
 
-DataRefIdent ovhtIdent[][64] =  {
-  "sim/cockpit2/annunciators/hvac"
-};
+SimLEDIntDR ovhtHvac(-1, ovhdRefs.hvac);
 
-SimLEDBase * ovhtAnncs[] = {
-  new SimLEDIntDR(-1, ovhtIdent[0])
+SimLEDBase * const ovhtAnncs[] = {
+  &ovhtHvac
 };
 
 
 
 /////// System annunciators
 
-// Here I'm creating six SystemAnnunciators, and creating an array of
-// pointers to them, in one go. It could alternately be done using
-// SystemAnnc foo(12, fltAnncs, sizeof(fltAnncs);
-// SystemAnnc baz(13, irsAnncs, sizeof(irsAnncs);
-// SystemAnnc * systemAnncs[] = { &foo, &baz };
-// syntax - your choice
-b737::SystemAnnc * systemAnncs[] = {
-  new b737::SystemAnnc(12, fltAnncs, sizeof(fltAnncs)),
-  new b737::SystemAnnc(13, irsAnncs, sizeof(irsAnncs)),
-  new b737::SystemAnnc(14, fuelAnncs, sizeof(fuelAnncs)),
-  new b737::SystemAnnc(15, elecAnncs, sizeof(elecAnncs)),
-  new b737::SystemAnnc(16, apuAnncs, sizeof(apuAnncs)),
-  new b737::SystemAnnc(17, ovhtAnncs, sizeof(ovhtAnncs))
+b737::SystemAnnc fltSA (12, fltAnncs);
+b737::SystemAnnc irsSA (13, irsAnncs);
+b737::SystemAnnc fuelSA(14, fuelAnncs);
+b737::SystemAnnc elecSA(15, elecAnncs);
+b737::SystemAnnc apuSA (16, apuAnncs);
+b737::SystemAnnc ovhtSA(17, ovhtAnncs);
+
+b737::SystemAnnc * const systemAnncs[] = {
+  &fltSA,
+  &irsSA,
+  &fuelSA,
+  &elecSA,
+  &apuSA,
+  &ovhtSA
 };
 
 
 
 ////// Master Caution light
 
-b737::MasterCaution masterCaution (24, systemAnncs, sizeof(systemAnncs));
+b737::MasterCaution masterCaution (24, systemAnncs);
 
 
 
-////// Ordinary Teensyduino buttons for inputs
+////// Glareshield buttons
 
-Bounce reset = Bounce(20, 5);  //left enc button
-Bounce recall = Bounce(11, 5); //right enc button
+// Read and debounced together by a SimSwitchBank at the start of each
+// SimObject::update(), which calls these functions as they change.
+
+// Reset all SystemAnncs belonging to masterCaution
+void resetCaution(void) { masterCaution.reset(); }
+
+// set/remove Recall mode on all SystemAnncs belonging to MasterCaution
+void recallHeld(bool held) { masterCaution.setRecall(held); }
+
+const int glareshieldPins[] = {
+  20,   // left enc button: reset
+  11    // right enc button: recall
+};
+SimSwitchBank glareshield(glareshieldPins);   // to ground, with pull-ups
+
+SimButton resetButton (glareshield, 0, resetCaution);
+SimSwitch recallButton(glareshield, 1, recallHeld);
 
 
 
 
 void setup() {
   SimObject::setup();
-  // b737::SystemAnnc and Mastercaution are derived from SimObject
-  // and are setup/updated by it
-
-  pinMode(11, INPUT_PULLUP);
-  pinMode(20, INPUT_PULLUP);
+  // more datarefs than SIM_DATAREF_INTS and SIM_DATAREF_FLOATS allow
+  if (SimDataRefs::overflow() != 0)
+    SimDataRefs::report(Serial);
+  // b737::SystemAnnc, MasterCaution and the glareshield buttons are
+  // SimObjects, and are setup/updated by it
 }
 
 
 
 void loop() {
   FlightSim.update();
-  recall.update();
-  reset.update();
-
-  // Reset all SystemAnncs belonging to masterCaution
-  if(reset.fallingEdge())
-    masterCaution.reset();
-
-  // set/remove Recall mode on all SystemAnncs belonging to MasterCaution
-  masterCaution.setRecall(!recall.read());
-
   SimObject::update();
 }
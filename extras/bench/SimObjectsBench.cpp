@@ -0,0 +1,248 @@
+// SimObjects update benchmark
+
+/*
+     * Copyright 2012 Jack Deeth
+     * Contact: simulationelectronics@gmail.com
+     *
+     * Measures construction, SimObject::setup() and SimObject::update()
+     * cost against object count and type mix, using the host backend.
+     * Each case runs in its own process so the SimObject registry starts
+     * empty, and is run with SimObject::setIncremental() off and on.
+     * Results are printed one JSON object per line.
+     *
+     *   g++ -O2 -DSIMOBJECTS_HOST -I. extras/bench/SimObjectsBench.cpp \
+     *       -o SimObjectsBench
+     *   ./SimObjectsBench                 # 10, 100, 1000, 10000 objects
+     *   ./SimObjectsBench 50 500          # chosen counts
+     *
+     * This program is free software: you can redistribute it and/or modify
+     * it under the terms of the GNU Lesser General Public License as
+     * published by the Free Software Foundation, either version 3 of the
+     * License, or (at your option) any later version.
+     *
+     * This program is distributed in the hope that it will be useful,
+     * but WITHOUT ANY WARRANTY; without even the implied warranty of
+     * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+     * GNU Lesser General Public License for more details.
+     *
+     * You should have received a copy of the GNU Lesser General Public
+     * License along with this program.
+     * If not, see <http://www.gnu.org/licenses/>.
+     *
+     * I would appreciate, but not insist, on attribution if this code is
+     * incorporated into other projects.
+     */
+
+// one of each per BENCH_IDENTS
+#define SIM_DATAREF_INTS 8
+#define SIM_DATAREF_FLOATS 8
+
+#include "SimObjectsDev.h"
+#include "SimLEDDev.h"
+#include "SimServoDev.h"
+#include "SystemAnnc.h"
+
+#include <algorithm>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+
+
+//! Format version of the JSON lines, bump when fields change
+const int BENCH_FORMAT = 4;
+
+//! Number of distinct datarefs the benchmark objects are spread over
+const int BENCH_IDENTS = 8;
+
+DataRefIdent intIdent[BENCH_IDENTS][16] = {
+  "bench/int0", "bench/int1", "bench/int2", "bench/int3",
+  "bench/int4", "bench/int5", "bench/int6", "bench/int7"
+};
+
+DataRefIdent floatIdent[BENCH_IDENTS][16] = {
+  "bench/float0", "bench/float1", "bench/float2", "bench/float3",
+  "bench/float4", "bench/float5", "bench/float6", "bench/float7"
+};
+
+ScaleMap benchMap = {
+  {   0,   0 },
+  {  25,  40 },
+  {  50,  90 },
+  { 100, 180 }
+};
+
+//! Sub-annunciators shared by every benchmark SystemAnnc
+SimLEDBase *benchSubAnncs[4];
+
+
+enum BenchType {
+  IntDR,
+  FloatDR,
+  Local,
+  Servo_,
+  SysAnnc,
+  Mix,
+  BenchTypeCount
+};
+
+const char *benchTypeName[BenchTypeCount] = {
+  "SimLEDIntDR",
+  "SimLEDFloatDR",
+  "SimLEDLocal",
+  "SimServo",
+  "b737::SystemAnnc",
+  "mix"
+};
+
+
+//! Nanosecond timestamp
+static double nowNs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+
+static void construct(BenchType type, int i) {
+  switch (type) {
+  case IntDR:
+    new SimLEDIntDR(i % 48, intIdent[i % BENCH_IDENTS], 1, 5);
+    break;
+  case FloatDR:
+    new SimLEDFloatDR(i % 48, floatIdent[i % BENCH_IDENTS], 0.25, 0.75);
+    break;
+  case Local:
+    new SimLEDLocal(i % 48);
+    break;
+  case Servo_:
+    new SimServo(i % 48, floatIdent[i % BENCH_IDENTS],
+                 benchMap, sizeof(benchMap));
+    break;
+  case SysAnnc:
+    new b737::SystemAnnc(i % 48, benchSubAnncs, sizeof(benchSubAnncs));
+    break;
+  case Mix:
+    // Roughly the proportions of an overhead panel
+    switch (i % 10) {
+    case 0:  construct(Servo_, i);  break;
+    case 1:  construct(SysAnnc, i); break;
+    case 2:
+    case 3:  construct(FloatDR, i); break;
+    case 4:  construct(Local, i);   break;
+    default: construct(IntDR, i);   break;
+    }
+    break;
+  default:
+    break;
+  }
+}
+
+
+//! Run one case and print its JSON line. Called in a child process.
+static void runCase(BenchType type, int count, bool incremental) {
+  SimHost::setEnabled(true);
+  SimObject::setIncremental(incremental);
+  for (int i = 0; i < BENCH_IDENTS; ++i) {
+    SimHost::setInt(intIdent[i], i);
+    SimHost::setFloat(floatIdent[i], i / (float)BENCH_IDENTS);
+  }
+
+  if (type == SysAnnc || type == Mix) {
+    for (int i = 0; i < 4; ++i)
+      benchSubAnncs[i] = new SimLEDIntDR(-1, intIdent[i], 2, 3);
+  }
+
+  double t0 = nowNs();
+  for (int i = 0; i < count; ++i)
+    construct(type, i);
+  double constructNs = nowNs() - t0;
+
+  t0 = nowNs();
+  SimObject::setup();
+  double setupNs = nowNs() - t0;
+
+  // Aim for about 0.5s of updates per case, within sensible limits
+  int iterations = (int)(5e5 / (count + 1));
+  if (iterations < 50)   iterations = 50;
+  if (iterations > 5000) iterations = 5000;
+
+  // Warm caches and branch predictors before timing
+  for (int i = 0; i < 10; ++i)
+    SimObject::update();
+
+  unsigned long pinWrites = SimHost::digitalWrites + SimHost::portWrites;
+  std::vector<double> samples(iterations);
+  for (int i = 0; i < iterations; ++i) {
+    // Move one input per pass so the objects see changing data
+    SimHost::setInt(intIdent[i % BENCH_IDENTS], i % 7);
+    SimHost::setFloat(floatIdent[i % BENCH_IDENTS], (i % 100) / 100.0f);
+
+    t0 = nowNs();
+    SimObject::update();
+    samples[i] = nowNs() - t0;
+  }
+
+  pinWrites = SimHost::digitalWrites + SimHost::portWrites - pinWrites;
+
+  std::sort(samples.begin(), samples.end());
+  double sum = 0;
+  for (int i = 0; i < iterations; ++i)
+    sum += samples[i];
+
+  int p99 = (int)(iterations * 0.99);
+  if (p99 >= iterations)
+    p99 = iterations - 1;
+
+  printf("{\"bench\":\"SimObjectsBench\",\"format\":%d,"
+         "\"type\":\"%s\",\"count\":%d,\"incremental\":%s,"
+         "\"iterations\":%d,"
+         "\"construct_us\":%.3f,\"setup_us\":%.3f,"
+         "\"update_mean_us\":%.3f,\"update_p99_us\":%.3f,"
+         "\"update_max_us\":%.3f,\"update_per_object_ns\":%.3f,"
+         "\"pin_writes_per_update\":%.3f,"
+         "\"datarefs\":%u,\"dataref_requests\":%u}\n",
+         BENCH_FORMAT, benchTypeName[type], count,
+         incremental ? "true" : "false", iterations,
+         constructNs / 1e3, setupNs / 1e3,
+         sum / iterations / 1e3, samples[p99] / 1e3,
+         samples[iterations - 1] / 1e3,
+         sum / iterations / (count ? count : 1),
+         (double)pinWrites / iterations,
+         SimDataRefs::unique(), SimDataRefs::requests());
+  fflush(stdout);
+}
+
+
+int main(int argc, char **argv) {
+  std::vector<int> counts;
+  for (int i = 1; i < argc; ++i)
+    counts.push_back(atoi(argv[i]));
+  if (counts.empty()) {
+    counts.push_back(10);
+    counts.push_back(100);
+    counts.push_back(1000);
+    counts.push_back(10000);
+  }
+
+  int failures = 0;
+  for (int t = 0; t < BenchTypeCount; ++t) {
+    for (size_t c = 0; c < counts.size(); ++c) {
+      for (int incremental = 0; incremental < 2; ++incremental) {
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid == 0) {
+          runCase((BenchType)t, counts[c], incremental);
+          _exit(0);
+        }
+        int status = 0;
+        waitpid(pid, &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+          fprintf(stderr, "case %s/%d failed\n", benchTypeName[t], counts[c]);
+          ++failures;
+        }
+      }
+    }
+  }
+
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,195 @@
+// SimObjects output bus check
+
+/*
+     * Copyright 2012 Jack Deeth
+     * Contact: simulationelectronics@gmail.com
+     *
+     * Checks SimShiftOutput and SimMCP23017Output against the fake SPI
+     * and I2C buses in extras/host: what reaches the registers, the
+     * order a shift register chain is sent in, that nothing is sent
+     * while no LED changes, and that a chip which misses a frame, drops
+     * off the bus and resets, or is missing at setup, is given its pin
+     * directions and latches once it answers.
+     * Prints "ok", or each failed check, and exits non-zero on failure.
+     *
+     *   g++ -DSIMOBJECTS_HOST -I. -Iextras/host \
+     *       extras/check/SimOutputBusCheck.cpp -o SimOutputBusCheck
+     *   ./SimOutputBusCheck
+     *
+     * This program is free software: you can redistribute it and/or modify
+     * it under the terms of the GNU Lesser General Public License as
+     * published by the Free Software Foundation, either version 3 of the
+     * License, or (at your option) any later version.
+     *
+     * This program is distributed in the hope that it will be useful,
+     * but WITHOUT ANY WARRANTY; without even the implied warranty of
+     * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+     * GNU Lesser General Public License for more details.
+     *
+     * You should have received a copy of the GNU Lesser General Public
+     * License along with this program.
+     * If not, see <http://www.gnu.org/licenses/>.
+     */
+
+#include <stdio.h>
+
+#include <SPI.h>
+#include <Wire.h>
+#include "SimObjectsDev.h"
+#include "SimLEDDev.h"
+#include "SimShiftOutputDev.h"
+#include "SimMCP23017OutputDev.h"
+
+
+static int failures = 0;
+
+#define CHECK(cond) \
+  do { \
+    if (!(cond)) { \
+      printf("line %d: %s\n", __LINE__, #cond); \
+      ++failures; \
+    } \
+  } while (0)
+
+
+//// Two 74HC595s, latched by pin 7
+
+SimShiftOutput<2> chain(7);
+
+SimLEDLocal chainFirst(chain.pin(0));    // nearest register, bit 0
+SimLEDLocal chainLast (chain.pin(9));    // furthest register, bit 1
+
+
+//// An MCP23017 at 0x21, with LEDs on GPA2 and GPB0
+
+const unsigned char expanderAddress = 0x21;
+
+SimMCP23017Output expander(1);
+
+SimLEDLocal expanderA2(expander.pin(2));
+SimLEDLocal expanderB0(expander.pin(8));
+
+
+//// Another at 0x22, not answering at setup, with an LED on GPB7
+
+const unsigned char lateAddress = 0x22;
+
+SimMCP23017Output late(2);
+
+SimLEDLocal lateB7(late.pin(15));
+
+
+//! Registers of the expander, as last written
+unsigned char iodirA(void) { return SimHost::i2cRegister(expanderAddress, 0x00); }
+unsigned char iodirB(void) { return SimHost::i2cRegister(expanderAddress, 0x01); }
+unsigned char olatA (void) { return SimHost::i2cRegister(expanderAddress, 0x14); }
+unsigned char olatB (void) { return SimHost::i2cRegister(expanderAddress, 0x15); }
+
+//! Put the expander's registers back to their power-on values
+void resetExpander(void) {
+  for (int reg = 0; reg < 256; ++reg)
+    SimHost::i2cRegisters[expanderAddress][reg] = 0;
+  SimHost::i2cRegisters[expanderAddress][0x00] = 0xFF;
+  SimHost::i2cRegisters[expanderAddress][0x01] = 0xFF;
+}
+
+
+void checkShiftOutput(void) {
+  // setup sends the blank frame, furthest register first
+  CHECK(SimHost::spiBytes == 2);
+  CHECK(SimHost::spiByte(1) == 0x00 && SimHost::spiByte(0) == 0x00);
+  CHECK(!SimHost::pin(7));
+
+  chainFirst.setActive(true);
+  chainLast.setActive(true);
+  SimObject::update();
+  CHECK(SimHost::spiBytes == 4);
+  CHECK(SimHost::spiByte(1) == 0x02);     // furthest register
+  CHECK(SimHost::spiByte(0) == 0x01);     // nearest register
+  CHECK(!SimHost::pin(7));
+
+  // nothing changed, nothing sent
+  unsigned long bytes = SimHost::spiBytes;
+  unsigned long transactions = SimHost::spiTransactions;
+  SimObject::update();
+  SimObject::update();
+  CHECK(SimHost::spiBytes == bytes);
+  CHECK(SimHost::spiTransactions == transactions);
+
+  chainLast.setActive(false);
+  SimObject::update();
+  CHECK(SimHost::spiBytes == bytes + 2);
+  CHECK(SimHost::spiByte(1) == 0x00 && SimHost::spiByte(0) == 0x01);
+}
+
+
+void checkMCP23017Output(void) {
+  // only the pins with LEDs are outputs
+  CHECK(iodirA() == 0xFB && iodirB() == 0xFE);
+  CHECK(olatA() == 0x00 && olatB() == 0x00);
+
+  expanderA2.setActive(true);
+  expanderB0.setActive(true);
+  SimObject::update();
+  CHECK(olatA() == 0x04 && olatB() == 0x01);
+
+  // nothing changed, nothing sent
+  unsigned long sent = SimHost::i2cTransmissions;
+  SimObject::update();
+  SimObject::update();
+  CHECK(SimHost::i2cTransmissions == sent);
+
+  // a frame the chip doesn't acknowledge is sent again when it answers
+  SimHost::setI2cPresent(expanderAddress, false);
+  expanderA2.setActive(false);
+  SimObject::update();
+  SimObject::update();
+  CHECK(olatA() == 0x04);
+  SimHost::setI2cPresent(expanderAddress, true);
+  SimObject::update();
+  CHECK(olatA() == 0x00 && olatB() == 0x01);
+
+  // a chip which dropped out may have reset to all inputs, so it is
+  // given its pin directions again before its latches
+  SimHost::setI2cPresent(expanderAddress, false);
+  expanderA2.setActive(true);
+  SimObject::update();
+  resetExpander();
+  SimHost::setI2cPresent(expanderAddress, true);
+  SimObject::update();
+  CHECK(iodirA() == 0xFB && iodirB() == 0xFE);
+  CHECK(olatA() == 0x04 && olatB() == 0x01);
+  sent = SimHost::i2cTransmissions;
+  SimObject::update();
+  CHECK(SimHost::i2cTransmissions == sent);
+}
+
+
+void checkMissingMCP23017(void) {
+  // the chip missing at setup gets its pin directions when it appears
+  CHECK(SimHost::i2cRegister(lateAddress, 0x01) == 0xFF);
+  lateB7.setActive(true);
+  SimObject::update();
+  CHECK(SimHost::i2cRegister(lateAddress, 0x15) == 0x00);
+  SimHost::setI2cPresent(lateAddress, true);
+  SimObject::update();
+  CHECK(SimHost::i2cRegister(lateAddress, 0x00) == 0xFF);
+  CHECK(SimHost::i2cRegister(lateAddress, 0x01) == 0x7F);
+  CHECK(SimHost::i2cRegister(lateAddress, 0x15) == 0x80);
+}
+
+
+int main(int, char **) {
+  resetExpander();
+  for (int reg = 0; reg < 2; ++reg)
+    SimHost::i2cRegisters[lateAddress][reg] = 0xFF;
+  SimHost::setI2cPresent(lateAddress, false);
+  SimObject::setup();
+  checkShiftOutput();
+  checkMCP23017Output();
+  checkMissingMCP23017();
+
+  if (failures == 0)
+    puts("ok");
+  return failures ? 1 : 0;
+}
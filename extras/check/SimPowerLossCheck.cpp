@@ -0,0 +1,128 @@
+// SimObjects power loss check
+
+/*
+     * Copyright 2012 Jack Deeth
+     * Contact: simulationelectronics@gmail.com
+     *
+     * Checks that dataref-fed SimLEDs go inactive when their SimPowerBus
+     * loses power, so the SystemAnnc and MasterCaution they feed go out
+     * too, and that they read their dataref afresh when power returns.
+     * Run with SimObject::setIncremental() off, then again with it on.
+     * Prints "ok", or each failed check, and exits non-zero on failure.
+     *
+     *   g++ -DSIMOBJECTS_HOST -I. -Iextras/host \
+     *       extras/check/SimPowerLossCheck.cpp -o SimPowerLossCheck
+     *   ./SimPowerLossCheck               # full updates
+     *   ./SimPowerLossCheck incremental   # incremental updates
+     *
+     * This program is free software: you can redistribute it and/or modify
+     * it under the terms of the GNU Lesser General Public License as
+     * published by the Free Software Foundation, either version 3 of the
+     * License, or (at your option) any later version.
+     *
+     * This program is distributed in the hope that it will be useful,
+     * but WITHOUT ANY WARRANTY; without even the implied warranty of
+     * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+     * GNU Lesser General Public License for more details.
+     *
+     * You should have received a copy of the GNU Lesser General Public
+     * License along with this program.
+     * If not, see <http://www.gnu.org/licenses/>.
+     */
+
+#include <stdio.h>
+
+#include "SimObjectsDev.h"
+#include "SimLEDDev.h"
+#include "SimPowerDev.h"
+#include "SystemAnnc.h"
+
+
+static int failures = 0;
+
+#define CHECK(cond) \
+  do { \
+    if (!(cond)) { \
+      printf("line %d: %s\n", __LINE__, #cond); \
+      ++failures; \
+    } \
+  } while (0)
+
+
+bool busFeed = true;
+SimPowerBus bus("check bus", &busFeed);
+
+SimLEDIntDR   subInt  (-1, "check/int");
+SimLEDFloatDR subFloat(-1, "check/float", 0.5, 1);
+
+SimLEDBase * const subAnncs[] = {
+  &subInt,
+  &subFloat
+};
+
+b737::SystemAnnc systemAnnc(-1, subAnncs);
+
+b737::SystemAnnc * const systemAnncs[] = {
+  &systemAnnc
+};
+
+b737::MasterCaution masterCaution(-1, systemAnncs);
+
+
+int main(int argc, char ** /*argv*/) {
+  if (argc > 1)
+    SimObject::setIncremental(true);
+  bus.attach(subInt);
+  bus.attach(subFloat);
+  SimObject::setup();
+
+  // a fault lights the lot
+  SimHost::setInt("check/int", 1);
+  SimObject::update();
+  CHECK(subInt.isActive());
+  CHECK(systemAnnc.isActive());
+  CHECK(masterCaution.isActive());
+
+  // without power the fault is gone, whatever the dataref does
+  busFeed = false;
+  SimObject::update();
+  CHECK(!subInt.isActive());
+  SimHost::setInt("check/int", 0);
+  SimObject::update();
+  CHECK(!subInt.isActive());
+
+  // so resetting puts the annunciators out, and recall leaves them out
+  masterCaution.reset();
+  SimObject::update();
+  CHECK(!systemAnnc.isActive());
+  CHECK(!masterCaution.isActive());
+  masterCaution.setRecall(true);
+  SimObject::update();
+  masterCaution.setRecall(false);
+  SimObject::update();
+  CHECK(!systemAnnc.isActive());
+  CHECK(!masterCaution.isActive());
+
+  // datarefs which changed while unpowered are read when power returns
+  SimHost::setFloat("check/float", 0.7f);
+  SimObject::update();
+  CHECK(!subFloat.isActive());
+  busFeed = true;
+  SimObject::update();
+  CHECK(subFloat.isActive());
+  CHECK(!subInt.isActive());
+  CHECK(systemAnnc.isActive());
+  CHECK(masterCaution.isActive());
+
+  // and so are ones which are unchanged since power went
+  SimHost::setInt("check/int", 1);
+  busFeed = false;
+  SimObject::update();
+  busFeed = true;
+  SimObject::update();
+  CHECK(subInt.isActive());
+
+  if (failures == 0)
+    puts("ok");
+  return failures ? 1 : 0;
+}
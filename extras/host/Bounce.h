@@ -0,0 +1,64 @@
+// Host stand-in for the Bounce library, for use with SimHALHost.h
+
+/*
+     * Copyright 2012 Jack Deeth
+     * Contact: simulationelectronics@gmail.com
+     *
+     * Provides the subset of the Bounce library used by the SimObjects
+     * examples, reading pins from the SimHost simulated board.
+     *
+     * This program is free software: you can redistribute it and/or modify
+     * it under the terms of the GNU Lesser General Public License as
+     * published by the Free Software Foundation, either version 3 of the
+     * License, or (at your option) any later version.
+     *
+     * This program is distributed in the hope that it will be useful,
+     * but WITHOUT ANY WARRANTY; without even the implied warranty of
+     * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+     * GNU Lesser General Public License for more details.
+     *
+     * You should have received a copy of the GNU Lesser General Public
+     * License along with this program.
+     * If not, see <http://www.gnu.org/licenses/>.
+     *
+     * I would appreciate, but not insist, on attribution if this code is
+     * incorporated into other projects.
+     */
+
+#ifndef BOUNCE_H
+#define BOUNCE_H
+
+#include "SimHALHost.h"
+
+class Bounce {
+public:
+  Bounce(uint8_t pin, unsigned long interval_millis)
+    : _pin(pin), _interval(interval_millis), _state(HIGH), _edge(0),
+      _previous(0) {}
+
+  //! Returns true if the debounced state changed
+  int update(void) {
+    _edge = 0;
+    uint8_t now = digitalRead(_pin);
+    if (now != _state && millis() - _previous >= _interval) {
+      _previous = millis();
+      _edge = now ? 1 : -1;
+      _state = now;
+      return 1;
+    }
+    return 0;
+  }
+
+  int read(void) { return _state; }
+  bool risingEdge(void)  { return _edge > 0; }
+  bool fallingEdge(void) { return _edge < 0; }
+
+private:
+  uint8_t _pin;
+  unsigned long _interval;
+  uint8_t _state;
+  int _edge;
+  unsigned long _previous;
+};
+
+#endif // BOUNCE_H
@@ -0,0 +1,86 @@
+// Host stand-in for the SPI library, for use with SimHALHost.h
+
+/*
+     * Copyright 2012 Jack Deeth
+     * Contact: simulationelectronics@gmail.com
+     *
+     * A fake SPI bus which records the bytes sent, so SPI output devices
+     * can be checked on the host.
+     *
+     * This program is free software: you can redistribute it and/or modify
+     * it under the terms of the GNU Lesser General Public License as
+     * published by the Free Software Foundation, either version 3 of the
+     * License, or (at your option) any later version.
+     *
+     * This program is distributed in the hope that it will be useful,
+     * but WITHOUT ANY WARRANTY; without even the implied warranty of
+     * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+     * GNU Lesser General Public License for more details.
+     *
+     * You should have received a copy of the GNU Lesser General Public
+     * License along with this program.
+     * If not, see <http://www.gnu.org/licenses/>.
+     *
+     * I would appreciate, but not insist, on attribution if this code is
+     * incorporated into other projects.
+     */
+
+#ifndef SPI_H
+#define SPI_H
+
+#include "SimHALHost.h"
+
+#define SPI_HAS_TRANSACTION 1
+
+#define LSBFIRST  0
+#define MSBFIRST  1
+#define SPI_MODE0 0x00
+
+//! Number of recent bytes kept by the fake bus
+#ifndef SIMHOST_SPI_LOG
+#define SIMHOST_SPI_LOG 256
+#endif
+
+namespace SimHost {
+
+//! Total bytes sent over SPI
+unsigned long spiBytes = 0;
+
+//! Total SPI transactions
+unsigned long spiTransactions = 0;
+
+//! The most recent bytes sent, oldest first in a ring
+uint8_t spiLog[SIMHOST_SPI_LOG];
+
+//! The byte sent age bytes ago; 0 is the most recent
+inline uint8_t spiByte(unsigned int age) {
+  if (age >= spiBytes || age >= SIMHOST_SPI_LOG)
+    return 0;
+  return spiLog[(spiBytes - 1 - age) % SIMHOST_SPI_LOG];
+}
+
+} // namespace SimHost
+
+
+class SPISettings {
+public:
+  SPISettings() {}
+  SPISettings(uint32_t, uint8_t, uint8_t) {}
+};
+
+class SPIClass {
+public:
+  static void begin(void) {}
+  static void beginTransaction(SPISettings) { ++SimHost::spiTransactions; }
+  static void endTransaction(void) {}
+
+  static uint8_t transfer(uint8_t data) {
+    SimHost::spiLog[SimHost::spiBytes % SIMHOST_SPI_LOG] = data;
+    ++SimHost::spiBytes;
+    return 0;
+  }
+};
+
+SPIClass SPI;
+
+#endif // SPI_H
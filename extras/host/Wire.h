@@ -0,0 +1,94 @@
+// Host stand-in for the Wire (I2C) library, for use with SimHALHost.h
+
+/*
+     * Copyright 2012 Jack Deeth
+     * Contact: simulationelectronics@gmail.com
+     *
+     * A fake I2C bus of register-file devices: the first byte of each
+     * transmission sets the register pointer and later bytes are written
+     * to successive registers, as on MCP23017 and most other I2C chips.
+     *
+     * This program is free software: you can redistribute it and/or modify
+     * it under the terms of the GNU Lesser General Public License as
+     * published by the Free Software Foundation, either version 3 of the
+     * License, or (at your option) any later version.
+     *
+     * This program is distributed in the hope that it will be useful,
+     * but WITHOUT ANY WARRANTY; without even the implied warranty of
+     * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+     * GNU Lesser General Public License for more details.
+     *
+     * You should have received a copy of the GNU Lesser General Public
+     * License along with this program.
+     * If not, see <http://www.gnu.org/licenses/>.
+     *
+     * I would appreciate, but not insist, on attribution if this code is
+     * incorporated into other projects.
+     */
+
+#ifndef TWOWIRE_H
+#define TWOWIRE_H
+
+#include "SimHALHost.h"
+
+namespace SimHost {
+
+//! Register files of the simulated I2C devices, by 7-bit address
+uint8_t i2cRegisters[128][256];
+
+//! Addresses which do not acknowledge. See setI2cPresent().
+bool i2cAbsent[128];
+
+//! Total completed transmissions
+unsigned long i2cTransmissions = 0;
+
+//! Register reg of the device at address, as last written
+inline uint8_t i2cRegister(uint8_t address, uint8_t reg) {
+  return i2cRegisters[address & 127][reg];
+}
+
+//! Make a device answer or not answer its address
+inline void setI2cPresent(uint8_t address, bool present) {
+  i2cAbsent[address & 127] = !present;
+}
+
+} // namespace SimHost
+
+
+class TwoWire {
+public:
+  TwoWire() : _address(0), _count(0) {}
+
+  void begin(void) {}
+  void setClock(uint32_t) {}
+
+  void beginTransmission(uint8_t address) {
+    _address = address & 127;
+    _count = 0;
+  }
+
+  size_t write(uint8_t data) {
+    if (_count < sizeof(_buf))
+      _buf[_count++] = data;
+    return 1;
+  }
+
+  //! Returns 0 on success, 2 if the address was not acknowledged
+  uint8_t endTransmission(void) {
+    if (SimHost::i2cAbsent[_address])
+      return 2;
+    ++SimHost::i2cTransmissions;
+    for (unsigned int i = 1; i < _count; ++i)
+      SimHost::i2cRegisters[_address][(uint8_t)(_buf[0] + i - 1)] = _buf[i];
+    return 0;
+  }
+
+private:
+  uint8_t _address;
+  uint8_t _buf[32];
+  unsigned int _count;
+};
+
+TwoWire Wire;
+
+#endif // TWOWIRE_H